@@ -0,0 +1,348 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE /* memmem */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include "search.h"
+
+/* Return codes */
+#define ERR_SUCCESS           0
+#define ERR_MISMATCH          1
+#define ERR_INVALID_PARAMETER 4
+#define ERR_OUT_OF_MEMORY     5
+
+#if defined(__GLIBC__) || defined(__APPLE__) || defined(__FreeBSD__)
+#define HAVE_MEMMEM
+#endif
+
+/* Synthetic images, every one is generated from a fixed seed,
+*  so the same size gives the same bytes on every run */
+#define CORPUS_PADDING 0  /* FF and 00 padding with sparse code blocks, like SPI images */
+#define CORPUS_ENTROPY 1  /* Random bytes, like compressed volumes */
+#define CORPUS_EFI     2  /* Code-like bytes rich in UTF-16 strings, like EFI drivers */
+#define CORPUS_COUNT   3
+
+static const char* const corpus_names[] = { "padding", "entropy", "efi" };
+
+/* Patterns are either random bytes or padding-like, a run of one byte closed by another */
+#define KIND_RANDOM  0
+#define KIND_PADDING 1
+#define KIND_COUNT   2
+
+static const char* const kind_names[] = { "random", "padding" };
+
+/* Planted matches: none, one per megabyte, one per 4 KB */
+static const size_t density_steps[] = { 0, 1024 * 1024, 4096 };
+static const char* const density_names[] = { "none", "sparse", "dense" };
+#define DENSITY_COUNT 3
+
+static const size_t pattern_lengths[] = { 2, 4, 8, 16, 32, 64 };
+#define LENGTH_COUNT (sizeof(pattern_lengths) / sizeof(pattern_lengths[0]))
+
+static const char* const engine_names[] = { "scalar", "sse2", "avx2", "avx512" };
+#define ENGINE_COUNT 4
+
+static const char* const efi_strings[] = {
+    "Intel(R) RST 16.8.0.1000 SATA Driver",
+    "Intel(R) GOP Driver [9.0.1074]",
+    "Copyright (c) 2016, Intel Corporation",
+    "EFI Network 1.0",
+    "PCI Option ROM",
+    "Version 4.1.04",
+};
+#define EFI_STRING_COUNT (sizeof(efi_strings) / sizeof(efi_strings[0]))
+
+/* Xorshift generator, the C library one differs between platforms */
+static uint32_t random_state;
+
+static uint32_t next_random(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+static void generate_corpus(uint8_t* buffer, size_t size, int corpus)
+{
+    size_t i, j, run;
+    const char* string;
+
+    random_state = 0x55425531u + (uint32_t) corpus;
+    i = 0;
+    switch (corpus)
+    {
+    case CORPUS_PADDING:
+        while (i < size)
+        {
+            /* Long padding run followed by a short block of code */
+            run = 4096 + next_random() % 65536;
+            for (j = 0; j < run && i < size; j++)
+                buffer[i++] = (next_random() & 3) ? 0xFF : 0x00;
+            run = 256 + next_random() % 4096;
+            for (j = 0; j < run && i < size; j++)
+                buffer[i++] = (uint8_t) next_random();
+        }
+        break;
+    case CORPUS_ENTROPY:
+        for (; i < size; i++)
+            buffer[i] = (uint8_t) next_random();
+        break;
+    case CORPUS_EFI:
+        while (i < size)
+        {
+            /* Code has a skewed byte distribution, strings are UTF-16LE */
+            run = 64 + next_random() % 512;
+            for (j = 0; j < run && i < size; j++)
+                buffer[i++] = (next_random() & 1) ? (uint8_t) (next_random() & 0x0F) : (uint8_t) next_random();
+            string = efi_strings[next_random() % EFI_STRING_COUNT];
+            for (j = 0; string[j] && i + 1 < size; j++)
+            {
+                buffer[i++] = (uint8_t) string[j];
+                buffer[i++] = 0x00;
+            }
+            if (i + 1 < size)
+            {
+                buffer[i++] = 0x00;
+                buffer[i++] = 0x00;
+            }
+        }
+        break;
+    }
+}
+
+static void generate_pattern(uint8_t* pattern, size_t length, int kind)
+{
+    size_t i;
+
+    for (i = 0; i < length; i++)
+        pattern[i] = kind == KIND_PADDING ? 0xFF : (uint8_t) next_random();
+    if (kind == KIND_PADDING)
+        pattern[length - 1] = 0x5A;
+}
+
+static double now_seconds(void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER counter, frequency;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    return (double) counter.QuadPart / (double) frequency.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+#endif
+}
+
+/* Methods timed for every case */
+#define METHOD_FIND   0  /* foreach_compiled, first match and every next one */
+#define METHOD_COUNT  1  /* count_compiled */
+#define METHOD_MEMMEM 2  /* C library memmem restarted after every match */
+
+static const char* const method_names[] = { "find", "count", "memmem" };
+
+static unsigned long run_method(int method, const compiled_pattern* compiled, const uint8_t* buffer, size_t size,
+                                const uint8_t* pattern, size_t length)
+{
+    unsigned long matches = 0;
+#ifdef HAVE_MEMMEM
+    const uint8_t* found;
+#endif
+
+    switch (method)
+    {
+    case METHOD_FIND:
+        return foreach_compiled(compiled, buffer, buffer + size, NULL, NULL);
+    case METHOD_COUNT:
+        return count_compiled(compiled, buffer, buffer + size);
+#ifdef HAVE_MEMMEM
+    case METHOD_MEMMEM:
+        for (found = (const uint8_t*) memmem(buffer, size, pattern, length); found;
+             found = (const uint8_t*) memmem(found + 1, size - (found + 1 - buffer), pattern, length))
+            matches++;
+        break;
+#endif
+    }
+
+    (void) pattern;
+    (void) length;
+    return matches;
+}
+
+/* Times one method, keeping the fastest of repeats runs */
+static double time_method(int method, const compiled_pattern* compiled, const uint8_t* buffer, size_t size,
+                          const uint8_t* pattern, size_t length, unsigned repeats, unsigned long* matches)
+{
+    double best = 0, start, elapsed;
+    unsigned i;
+
+    for (i = 0; i < repeats; i++)
+    {
+        start = now_seconds();
+        *matches = run_method(method, compiled, buffer, size, pattern, length);
+        elapsed = now_seconds() - start;
+        if (i == 0 || elapsed < best)
+            best = elapsed;
+    }
+    return best;
+}
+
+static void print_result(const char* corpus, const char* kind, size_t length, const char* density,
+                         const char* engine, const char* method, size_t size, unsigned long matches, double seconds)
+{
+    if (seconds <= 0)
+        seconds = 1e-9;
+    printf("%s,%s,%lu,%s,%s,%s,%lu,%lu,%.6f,%.3f,%.0f\n", corpus, kind, (unsigned long) length, density,
+           engine, method, (unsigned long) size, matches, seconds, (double) size / seconds / 1e9,
+           (double) matches / seconds);
+}
+
+/* Entry point */
+int main(int argc, char* argv[])
+{
+    uint8_t* corpus;
+    uint8_t* buffer;
+    uint8_t  pattern[64];
+    size_t   size;
+    size_t   offset;
+    size_t   l;
+    unsigned repeats;
+    int      c, k, d, e, method;
+    int      arg;
+    int      engines;
+    int      checked;
+    const char* engine_filter;
+    compiled_pattern* compiled;
+    unsigned long matches, expected;
+    double   seconds;
+    uint8_t  result;
+
+    /* Parsing options */
+    size = 32;
+    repeats = 3;
+    engine_filter = NULL;
+    for (arg = 1; arg < argc; arg++)
+    {
+        if (!strcmp(argv[arg], "-s") && arg + 1 < argc)
+            size = strtoul(argv[++arg], NULL, 10);
+        else if (!strcmp(argv[arg], "-r") && arg + 1 < argc)
+            repeats = (unsigned) strtoul(argv[++arg], NULL, 10);
+        else if (!strcmp(argv[arg], "-e") && arg + 1 < argc)
+            engine_filter = argv[++arg];
+        else
+        {
+            printf("searchbench v0.1.0\n"
+                "Times search engines on synthetic firmware images\n\n"
+                "Usage: searchbench [-s MB] [-r N] [-e ENGINE]\n"
+                "Options:\n"
+                "-s MB      - Size of every synthetic image in megabytes, 32 by default\n"
+                "-r N       - Runs of every case, the fastest one is reported, 3 by default\n"
+                "-e ENGINE  - Time only scalar, sse2, avx2 or avx512 engine\n\n"
+                "Prints CSV: corpus,pattern,length,density,engine,method,bytes,matches,seconds,gb_per_s,matches_per_s\n");
+            return ERR_INVALID_PARAMETER;
+        }
+    }
+    if (!size || !repeats)
+    {
+        printf("Size and repeats must be positive.\n");
+        return ERR_INVALID_PARAMETER;
+    }
+    size *= 1024 * 1024;
+
+    corpus = (uint8_t*) malloc(size);
+    buffer = (uint8_t*) malloc(size);
+    if (!corpus || !buffer)
+    {
+        printf("Can't allocate memory for images.\n");
+        return ERR_OUT_OF_MEMORY;
+    }
+
+    /* Engines this CPU can run */
+    for (engines = 0; engines < ENGINE_COUNT; engines++)
+        if (!strcmp(find_pattern_engine(), engine_names[engines]))
+            break;
+    engines++;
+
+    result = ERR_SUCCESS;
+    printf("corpus,pattern,length,density,engine,method,bytes,matches,seconds,gb_per_s,matches_per_s\n");
+    for (c = 0; c < CORPUS_COUNT; c++)
+    {
+        generate_corpus(corpus, size, c);
+        for (k = 0; k < KIND_COUNT; k++)
+        {
+            for (l = 0; l < LENGTH_COUNT; l++)
+            {
+                /* Padding-like patterns of 2 bytes are not padding-like */
+                if (k == KIND_PADDING && pattern_lengths[l] < 4)
+                    continue;
+
+                generate_pattern(pattern, pattern_lengths[l], k);
+                compiled = compile_pattern(pattern, NULL, pattern_lengths[l]);
+                if (!compiled)
+                {
+                    printf("Can't allocate memory for pattern.\n");
+                    return ERR_OUT_OF_MEMORY;
+                }
+
+                for (d = 0; d < DENSITY_COUNT; d++)
+                {
+                    /* Planting matches into a fresh copy of the image */
+                    memcpy(buffer, corpus, size);
+                    if (density_steps[d])
+                        for (offset = density_steps[d] / 2; offset + pattern_lengths[l] <= size; offset += density_steps[d])
+                            memcpy(buffer + offset, pattern, pattern_lengths[l]);
+
+                    /* Every engine and method must find the same matches */
+                    expected = 0;
+                    checked = 0;
+                    for (e = 0; e < engines; e++)
+                    {
+                        if (engine_filter && strcmp(engine_filter, engine_names[e]))
+                            continue;
+                        select_search_engine(engine_names[e]);
+                        for (method = METHOD_FIND; method <= METHOD_COUNT; method++)
+                        {
+                            seconds = time_method(method, compiled, buffer, size, pattern, pattern_lengths[l],
+                                                  repeats, &matches);
+                            print_result(corpus_names[c], kind_names[k], pattern_lengths[l], density_names[d],
+                                         engine_names[e], method_names[method], size, matches, seconds);
+                            if (!checked++)
+                                expected = matches;
+                            else if (matches != expected)
+                                result = ERR_MISMATCH;
+                        }
+                    }
+
+#ifdef HAVE_MEMMEM
+                    seconds = time_method(METHOD_MEMMEM, NULL, buffer, size, pattern, pattern_lengths[l],
+                                          repeats, &matches);
+                    print_result(corpus_names[c], kind_names[k], pattern_lengths[l], density_names[d],
+                                 "libc", method_names[METHOD_MEMMEM], size, matches, seconds);
+                    if (checked && matches != expected)
+                        result = ERR_MISMATCH;
+#endif
+                }
+
+                free_compiled_pattern(compiled);
+            }
+        }
+    }
+
+    if (result == ERR_MISMATCH)
+        fprintf(stderr, "Engines disagree on match counts.\n");
+
+    free(buffer);
+    free(corpus);
+    return result;
+}
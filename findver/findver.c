@@ -4,6 +4,15 @@
 #include <ctype.h>
 #include <stdint.h>
 
+#include "acmatch.h"
+#include "extract.h"
+#include "image.h"
+#include "ngram.h"
+#include "pattern.h"
+#include "search.h"
+#include "stats.h"
+#include "trace.h"
+
 /* Return codes */
 #define ERR_SUCCESS           0
 #define ERR_NOT_FOUND         1
@@ -14,130 +23,553 @@
 #define ERR_UNKNOWN_VERSION   6
 #define ERR_UNKNOWN_OPTION    7
 
-/* Implementation of GNU memmem function using Boyer-Moore-Horspool algorithm
-*  Returns pointer to the beginning of found pattern or NULL if not found */
-uint8_t* find_pattern(uint8_t* begin, uint8_t* end, 
-                      const uint8_t* pattern, size_t plen)
+/* Arguments of print_location for matches reported by the index */
+typedef struct
 {
-    size_t scan = 0;
-    size_t bad_char_skip[256];
-    size_t last;
-    size_t slen;
-
-    if (plen == 0 || !begin || !pattern || !end || end <= begin)
-        return NULL;
+    const char* prefix;
+    const uint8_t* buffer;
+    const uint8_t* end;
+    long offset;
+    uint8_t end_pattern;
+    unsigned long max_length;
+    long num_location;
+    long count;
+} print_context;
 
-    slen = end - begin;
+static int print_match(void* context, const uint8_t* match)
+{
+    print_context* print = (print_context*) context;
+    trace_span span;
+
+    stats_phase(STATS_EXTRACT);
+    trace_begin(&span);
+    print_location(stdout, print->prefix, print->buffer, match, print->end, print->offset, print->end_pattern,
+                   print->max_length);
+    trace_end(&span, "extract", "Extract %s", print->prefix);
+    stats_phase(STATS_SCAN);
+    return ++print->count >= print->num_location;
+}
 
-    for (scan = 0; scan <= 255; scan++)
-        bad_char_skip[scan] = plen;
+uint8_t print_version(const char* prefix, uint8_t* buffer, uint8_t* end,
+                           const uint8_t* pattern, const uint8_t* mask, const uint32_t size, 
+                           const long offset, const uint8_t end_pattern,
+                           const unsigned long max_length,
+                           const long num_location, const ngram_index* index)
+{
+    compiled_pattern* compiled;
+    print_context print;
+    stats_mark mark;
+    trace_span span;
+    unsigned long matches;
+    uint8_t *found;
+    uint8_t isFound = 0;
+    uint8_t count = 0;
+    
+    if (!prefix || !buffer || !end || !pattern || !size || !max_length || !num_location)
+        return ERR_INVALID_PARAMETER;
 
-    last = plen - 1;
+    /* Index reports matches in file order, same as the scan. Negative
+    *  location counts print nothing, the scan reports them as not found */
+    stats_phase(STATS_SCAN);
+    if (index && num_location > 0)
+    {
+        print.prefix = prefix;
+        print.buffer = buffer;
+        print.end = end;
+        print.offset = offset;
+        print.end_pattern = end_pattern;
+        print.max_length = max_length;
+        print.num_location = num_location;
+        print.count = 0;
+        trace_begin(&span);
+        if (!ngram_foreach(index, pattern, mask, size, print_match, &print, &matches))
+        {
+            trace_end(&span, "scan", "Index lookup %s", prefix);
+            return matches ? ERR_SUCCESS : ERR_NOT_FOUND;
+        }
+    }
 
-    for (scan = 0; scan < last; scan++)
-        bad_char_skip[pattern[scan]] = last - scan;
+    /* Pattern is compiled once for all locations, searches are charged to the only entry */
+    stats_phase(STATS_COMPILE);
+    compiled = compile_pattern(pattern, mask, size);
+    if (!compiled)
+        return ERR_OUT_OF_MEMORY;
 
-    while (slen >= plen)
+    stats_phase(STATS_SCAN);
+    stats_begin(&mark);
+    trace_begin(&span);
+    found = search_compiled(compiled, buffer, end);
+    trace_end(&span, "scan", "Search %s", prefix);
+    stats_end(&mark, 0);
+    while (found != NULL && count < num_location)
     {
-        for (scan = last; begin[scan] == pattern[scan]; scan--)
-            if (scan == 0)
-                return begin;
-
-        slen    -= bad_char_skip[begin[last]];
-        begin   += bad_char_skip[begin[last]];
+        isFound = 1;
+        stats_phase(STATS_EXTRACT);
+        trace_begin(&span);
+        print_location(stdout, prefix, buffer, found, end, offset, end_pattern, max_length);
+        trace_end(&span, "extract", "Extract %s", prefix);
+        count++;
+        stats_phase(STATS_SCAN);
+        stats_begin(&mark);
+        trace_begin(&span);
+        found = search_compiled(compiled, found + 1, end);
+        trace_end(&span, "scan", "Search %s", prefix);
+        stats_end(&mark, 0);
     }
+    free_compiled_pattern(compiled);
 
-    return NULL;
+    if (isFound)
+        return ERR_SUCCESS;
+    else
+        return ERR_NOT_FOUND;
 }
 
-/* Converts ASCII-string to hexadecimal pattern */
-uint8_t read_pattern(const char* string, uint8_t* pattern[], size_t* length)
+/* One row of spec file, same fields as command line arguments */
+typedef struct
 {
-    size_t  i;
-    const char* current;
-    char  buf[3];
-
-    buf[2] = 0;
+    char*    prefix;
+    uint8_t* pattern;
+    uint8_t* mask;
+    size_t   length;
+    long     offset;
+    uint8_t  end_marker;
+    unsigned long max_length;
+    long     num_location;
+    uint8_t** found;         /* Locations in file order */
+    long     count;
+    long     capacity;
+} version_query;
+
+/* Queries of spec file and matches collected for them */
+typedef struct
+{
+    version_query* queries;
+    size_t count;
+    size_t pending;          /* Queries scanned with automaton that want more locations */
+    uint8_t failed;
+} query_set;
+
+/* Reads spec file, one query per line: prefix pattern offset end_marker max_length num_location
+*  Empty lines and lines starting with # are skipped */
+static uint8_t read_spec_file(const char* filename, char** text, version_query** queries, size_t* count)
+{
+    FILE*  file;
+    long   filesize;
+    size_t i, lines;
+    char*  line;
+    char*  next;
+    char*  fields[6];
+    uint8_t* end_marker;
+    size_t end_marker_length;
+    version_query* query;
 
-    *length = strlen(string);
-    if (*length % 2)
-        return ERR_INVALID_PARAMETER;
+    file = fopen(filename, "rb");
+    if (!file)
+        return ERR_FILE_OPEN;
 
-    *length /= 2;
+    fseek(file, 0, SEEK_END);
+    filesize = ftell(file);
+    fseek(file, 0, SEEK_SET);
 
-    *pattern = (uint8_t*) malloc(*length);
+    *text = (char*) malloc(filesize + 1);
+    if (!*text)
+    {
+        fclose(file);
+        return ERR_OUT_OF_MEMORY;
+    }
 
-    for (current = string, i = 0; i < *length; i++)
+    if (fread(*text, sizeof(char), filesize, file) != (size_t) filesize)
     {
-        buf[0] = *current++;
-        buf[1] = *current++;
+        fclose(file);
+        return ERR_FILE_READ;
+    }
+    fclose(file);
+    (*text)[filesize] = 0;
 
-        if (!isxdigit(buf[0]) || !isxdigit(buf[1]))
+    /* Counting lines to size query array */
+    lines = 1;
+    for (i = 0; i < (size_t) filesize; i++)
+        if ((*text)[i] == '\n')
+            lines++;
+
+    *queries = (version_query*) calloc(lines, sizeof(version_query));
+    if (!*queries)
+        return ERR_OUT_OF_MEMORY;
+
+    *count = 0;
+    for (line = *text; line; line = next)
+    {
+        next = strchr(line, '\n');
+        if (next)
+            *next++ = 0;
+        if (*line && line[strlen(line) - 1] == '\r')
+            line[strlen(line) - 1] = 0;
+
+        while (*line == ' ' || *line == '\t')
+            line++;
+        if (!*line || *line == '#')
+            continue;
+
+        for (i = 0; i < 6; i++)
+            if (!(fields[i] = next_field(&line)))
+                break;
+        query = &(*queries)[*count];
+        if (i < 6 || read_pattern(fields[1], &query->pattern, &query->mask, &query->length) || !query->length ||
+            read_pattern(fields[3], &end_marker, NULL, &end_marker_length) || end_marker_length != 1)
+        {
+            printf("Spec line %lu can't be parsed.\n", (unsigned long) (*count + 1));
             return ERR_INVALID_PARAMETER;
-        else 
-            (*pattern)[i] = (uint8_t) strtoul(buf, NULL, 16);
+        }
+
+        query->prefix = fields[0];
+        query->offset = strtol(fields[2], NULL, 10);
+        query->end_marker = *end_marker;
+        query->max_length = labs(strtol(fields[4], NULL, 10));
+        query->num_location = strtol(fields[5], NULL, 10);
+        free(end_marker);
+        if (!query->max_length || !query->num_location)
+        {
+            printf("Spec line %lu can't be parsed.\n", (unsigned long) (*count + 1));
+            return ERR_INVALID_PARAMETER;
+        }
+        (*count)++;
     }
 
     return ERR_SUCCESS;
 }
 
-uint8_t print_version(const char* prefix, uint8_t* buffer, uint8_t* end,
-                           const uint8_t* pattern, const uint32_t size, 
-                           const long offset, const uint8_t end_pattern,
-                           const unsigned long max_length,
-                           const long num_location)
+/* Adds location to query, returns nonzero when the query has enough of them */
+static int add_location(query_set* set, version_query* query, const uint8_t* match)
 {
-    uint8_t *found, *terminate;
-    uint8_t isFound = 0;
-    uint8_t count = 0;
-    
-    if (!prefix || !buffer || !end || !pattern || !size || !max_length || !num_location)
-        return ERR_INVALID_PARAMETER;
+    uint8_t** grown;
 
-    found = find_pattern(buffer, end, pattern, size);
-    while (found != NULL && count < num_location)
+    if (query->count >= query->num_location)
+        return 1;
+
+    if (query->count == query->capacity)
     {
-        isFound = 1;
-        terminate = find_pattern(found + offset, end, &end_pattern, 1);
-        if ((unsigned long) (terminate - found - offset) > max_length)
-            terminate = found + offset + max_length;
-        *terminate = 0x00;
-        printf("%s%s\n", prefix, found + offset);
-        count++;
-        found = find_pattern(found + 1, end, pattern, size);
+        query->capacity = query->capacity ? query->capacity * 2 : 4;
+        grown = (uint8_t**) realloc(query->found, query->capacity * sizeof(uint8_t*));
+        if (!grown)
+        {
+            set->failed = 1;
+            return 1;
+        }
+        query->found = grown;
     }
+    query->found[query->count++] = (uint8_t*) match;
+    return query->count >= query->num_location;
+}
+
+/* Collects automaton matches, stops the scan when every query is satisfied */
+static int collect_match(void* context, size_t pattern, const uint8_t* match)
+{
+    query_set* set = (query_set*) context;
+    version_query* query = &set->queries[pattern];
+
+    stats_add(pattern, 0, 0, 0, 1);
+    if (query->count < query->num_location && add_location(set, query, match))
+        set->pending--;
+    return set->failed || !set->pending;
+}
+
+/* Collects matches of one query reported by index or compiled pattern search */
+static int collect_query(void* context, const uint8_t* match)
+{
+    query_set* set = (query_set*) ((void**) context)[0];
+    version_query* query = (version_query*) ((void**) context)[1];
+
+    return add_location(set, query, match);
+}
+
+/* Answers all queries of spec file with one pass over the image, literal
+*  patterns are found together by automaton, patterns with wildcards and
+*  patterns found in the index are looked up separately */
+static uint8_t print_versions(const char* spec_name, const char* image_name, int use_index, int stats, int perf)
+{
+    image_t  image;
+    char*    text;
+    query_set set;
+    version_query* query;
+    size_t*  lengths;
+    uint8_t** patterns;
+    uint8_t* indexed;
+    compiled_pattern* compiled;
+    uint8_t* found;
+    void*    context[2];
+    unsigned long matches;
+    stats_mark mark;
+    trace_span span;
+    ac_automaton ac;
+    ngram_index index;
+    size_t   i;
+    long     j;
+    uint8_t  isFound = 0;
+    uint8_t  result;
+
+    memset(&set, 0, sizeof(set));
+    stats_phase(STATS_LOAD);
+    result = read_spec_file(spec_name, &text, &set.queries, &set.count);
+    if (result == ERR_FILE_OPEN)
+        printf("Spec file can't be opened.\n");
+    else if (result == ERR_FILE_READ)
+        printf("Can't read spec file.\n");
+    else if (result == ERR_OUT_OF_MEMORY)
+        printf("Can't allocate memory for spec file.\n");
+    if (result)
+        return result;
+
+    /* Queries are statistics entries, named by their prefixes, the automaton is the last one */
+    if (stats && stats_start(set.count + 1))
+    {
+        printf("Can't allocate memory for statistics.\n");
+        return ERR_OUT_OF_MEMORY;
+    }
+    if (perf && stats_perf())
+        fprintf(stderr, "Performance counters are not available, statistics are printed without them.\n");
+    for (i = 0; i < set.count; i++)
+        stats_name(i, set.queries[i].prefix);
+    stats_name(set.count, "(automaton)");
+
+    /* Mapping file */
+    trace_begin(&span);
+    result = load_image(image_name, &image, IMAGE_READ_ONLY);
+    trace_end(&span, "load", "Load %s", image_name);
+    if (result == ERR_FILE_OPEN)
+        printf("File can't be opened.\n");
+    else if (result == ERR_OUT_OF_MEMORY)
+        printf("Can't allocate memory for file contents.\n");
+    else if (result)
+        printf("Can't read file.\n");
+    if (result)
+        return result;
+
+    lengths = (size_t*) calloc(set.count ? set.count : 1, sizeof(size_t));
+    patterns = (uint8_t**) calloc(set.count ? set.count : 1, sizeof(uint8_t*));
+    indexed = (uint8_t*) calloc(set.count ? set.count : 1, 1);
+    if (!lengths || !patterns || !indexed)
+    {
+        printf("Can't allocate memory for patterns.\n");
+        return ERR_OUT_OF_MEMORY;
+    }
+
+    /* Looking queries up in the index first */
+    stats_phase(STATS_SCAN);
+    if (use_index && !ngram_attach(image_name, &image, &index))
+    {
+        context[0] = &set;
+        for (i = 0; i < set.count; i++)
+        {
+            query = &set.queries[i];
+            context[1] = query;
+            trace_begin(&span);
+            if (!ngram_foreach(&index, query->pattern, query->mask, query->length, collect_query, context, &matches))
+                indexed[i] = 1;
+            trace_end(&span, "scan", "Index lookup %s", query->prefix);
+        }
+        ngram_close(&index);
+    }
+
+    /* Patterns with wildcards are searched one by one */
+    for (i = 0; i < set.count; i++)
+    {
+        query = &set.queries[i];
+        patterns[i] = query->pattern;
+        if (indexed[i] || query->num_location < 0)
+            continue;
+        if (!query->mask)
+        {
+            lengths[i] = query->length;
+            set.pending++;
+            continue;
+        }
+
+        stats_phase(STATS_COMPILE);
+        compiled = compile_pattern(query->pattern, query->mask, query->length);
+        if (!compiled)
+        {
+            printf("Can't allocate memory for patterns.\n");
+            return ERR_OUT_OF_MEMORY;
+        }
+        stats_phase(STATS_SCAN);
+        stats_begin(&mark);
+        trace_begin(&span);
+        for (found = search_compiled(compiled, image.data, image.data + image.size); found;
+             found = search_compiled(compiled, found + 1, image.data + image.size))
+            if (add_location(&set, query, found))
+                break;
+        trace_end(&span, "scan", "Search %s", query->prefix);
+        stats_end(&mark, i);
+        free_compiled_pattern(compiled);
+    }
+
+    /* Literal patterns are found in one pass, matches are collected first
+    *  and printed in spec order */
+    if (set.pending)
+    {
+        stats_phase(STATS_COMPILE);
+        if (ac_build(&ac, patterns, lengths, set.count))
+        {
+            printf("Can't allocate memory for patterns.\n");
+            return ERR_OUT_OF_MEMORY;
+        }
+        stats_phase(STATS_SCAN);
+        stats_begin(&mark);
+        trace_begin(&span);
+        ac_scan(&ac, image.data, image.data + image.size, collect_match, &set);
+        trace_end(&span, "scan", "Automaton");
+
+        /* Every position scanned is a candidate of each pattern of the automaton */
+        if (mark.thread)
+            for (i = 0; i < set.count; i++)
+                if (lengths[i])
+                    stats_add(i, 0, 0, mark.thread->candidates - mark.start.candidates, 0);
+        stats_end(&mark, set.count);
+        ac_free(&ac);
+    }
+    if (set.failed)
+    {
+        printf("Can't allocate memory for matches.\n");
+        return ERR_OUT_OF_MEMORY;
+    }
+
+    /* Printing locations in spec order, each query in file order */
+    stats_phase(STATS_EXTRACT);
+    for (i = 0; i < set.count; i++)
+    {
+        query = &set.queries[i];
+        for (j = 0; j < query->count; j++)
+        {
+            isFound = 1;
+            trace_begin(&span);
+            print_location(stdout, query->prefix, image.data, query->found[j], image.data + image.size, query->offset,
+                           query->end_marker, query->max_length);
+            trace_end(&span, "extract", "Extract %s", query->prefix);
+        }
+        free(query->found);
+    }
+
     if (isFound)
         return ERR_SUCCESS;
     else
         return ERR_NOT_FOUND;
 }
 
+/* Writes trace and statistics of the run, result of the run is kept unless they can't be written */
+static uint8_t finish_run(const char* stats_file, uint8_t result)
+{
+    uint8_t status;
+
+    status = trace_finish();
+    if (status == ERR_OUT_OF_MEMORY)
+        printf("Can't allocate memory for trace, some events are missing.\n");
+    else if (status)
+        printf("Can't write trace file.\n");
+    if (status)
+        result = status;
+
+    status = stats_report(stderr, stats_file);
+    if (status == ERR_FILE_OPEN)
+        printf("Statistics file can't be opened.\n");
+    else if (status)
+        printf("Can't allocate memory for statistics.\n");
+    return status ? status : result;
+}
+
 /* Entry point */
 int main(int argc, char* argv[])
 
 {
-    FILE*    file;
+    image_t  image;
     uint8_t* buffer;
     uint8_t* end;
-    long filesize;
-    long read;
     size_t pattern_length;
     uint8_t* pattern;
+    uint8_t* pattern_mask;
     size_t end_marker_length;
     uint8_t* end_marker_pattern;
     long offset;
     long max_length;
     long num_location;
+    ngram_index index;
+    const char* stats_file;
+    const char* trace_file;
+    trace_span span;
+    int use_index;
+    int stats;
+    int perf;
     uint8_t result;
 
+    /* Options go before positional arguments */
+    use_index = 0;
+    stats = 0;
+    perf = 0;
+    stats_file = NULL;
+    trace_file = NULL;
+    while (argc > 1)
+    {
+        if (!strcmp(argv[1], "-i"))
+            use_index = 1;
+        else if (!strcmp(argv[1], "--stats"))
+            stats = 1;
+        else if (!strcmp(argv[1], "--perf-counters"))
+        {
+            stats = 1;
+            perf = 1;
+        }
+        else if (argc > 2 && !strcmp(argv[1], "--stats-json"))
+        {
+            stats = 1;
+            stats_file = argv[2];
+            argc--;
+            argv++;
+        }
+        else if (argc > 2 && !strcmp(argv[1], "--trace"))
+        {
+            trace_file = argv[2];
+            argc--;
+            argv++;
+        }
+        else
+            break;
+        argc--;
+        argv++;
+    }
+
+    /* Trace file is created only for runs that get past the usage text */
+    if (trace_file && (argc >= 8 || (argc == 4 && !strcmp(argv[1], "-f"))) && trace_start(trace_file))
+    {
+        printf("Trace file can't be opened.\n");
+        return ERR_FILE_OPEN;
+    }
+
+    if (argc == 4 && !strcmp(argv[1], "-f"))
+    {
+        result = print_versions(argv[2], argv[3], use_index, stats, perf);
+        return finish_run(stats_file, result);
+    }
+
     if (argc < 8)
     {
-        printf("findver v0.3.2\n"
+        printf("findver v0.4.0\n"
             "Prints version string found in input file\n\n"
-            "Usage: findver prefix pattern offset end_marker max_length FILE\n"
+            "Usage: findver [-i] [--stats] [--stats-json JSONFILE] [--perf-counters] [--trace TRACEFILE]\n"
+            "               prefix pattern offset end_marker max_length FILE\n"
+            "       findver [-i] [--stats] [--stats-json JSONFILE] [--perf-counters] [--trace TRACEFILE] -f SPECFILE FILE\n"
             "Options:\n"
+            "-i          - Look pattern up in FILE" NGRAM_EXTENSION " index, build it if it is missing or stale\n"
+            "--stats     - Print bytes scanned, searches, candidates and matches of every pattern\n"
+            "              and time of every phase to stderr\n"
+            "--stats-json JSONFILE - Write the same statistics to JSONFILE as JSON\n"
+            "--perf-counters - Add cycles, instructions, L1D and LLC misses and branch mispredictions\n"
+            "              of the scan per byte scanned to statistics, where Linux offers them\n"
+            "--trace TRACEFILE - Write load of FILE, every search and every extracted version\n"
+            "              to TRACEFILE in Chrome trace event format\n"
+            "-f SPECFILE - Answer every line of SPECFILE in one pass over FILE, a line holds\n"
+            "              prefix pattern offset end_marker max_length num_location,\n"
+            "              prefix may be quoted, lines starting with # are skipped\n"
             "prefix      - Prefix string, ASCII symbols\n"
-            "pattern     - Pattern to find, hex digits\n"
+            "pattern     - Pattern to find, hex digits, ?? matches any byte, 4? or ?4 one nibble\n"
             "offset      - Offset of version string, integer\n"
             "end_marker  - Pattern that marks end of version string, 2 hex digits\n"
 
@@ -152,46 +584,44 @@ int main(int argc, char* argv[])
 
 
 
-    /* Opening file */
-    file = fopen(argv[7], "rb");
-    if (!file)
+    if (stats)
     {
-        printf("File can't be opened.\n");
-        return ERR_FILE_OPEN;
+        if (stats_start(1))
+        {
+            printf("Can't allocate memory for statistics.\n");
+            return ERR_OUT_OF_MEMORY;
+        }
+        if (perf && stats_perf())
+            fprintf(stderr, "Performance counters are not available, statistics are printed without them.\n");
+        stats_name(0, argv[2]);
     }
 
-    /* Determining file size */
-    fseek(file, 0, SEEK_END);
-    filesize = ftell(file);
-    fseek(file, 0, SEEK_SET);
-
-    /* Allocating memory for buffer */
-    buffer = (uint8_t*) malloc(filesize);
-    if (!buffer)
-    {
+    /* Mapping file */
+    stats_phase(STATS_LOAD);
+    trace_begin(&span);
+    result = load_image(argv[7], &image, IMAGE_READ_ONLY);
+    trace_end(&span, "load", "Load %s", argv[7]);
+    if (result == ERR_FILE_OPEN)
+        printf("File can't be opened.\n");
+    else if (result == ERR_OUT_OF_MEMORY)
         printf("Can't allocate memory for file contents.\n");
-        return ERR_OUT_OF_MEMORY;
-    }
-
-    /* Reading whole file to buffer */
-    read = fread((void*) buffer, sizeof(char), filesize, file);
-    if (read != filesize)
-    {
+    else if (result)
         printf("Can't read file.\n");
-        return ERR_FILE_READ;
-    }
+    if (result)
+        return result;
 
-    end = buffer + filesize;
+    buffer = image.data;
+    end = buffer + image.size;
 
     /* Parse arguments */
         
-    result = read_pattern(argv[2], &pattern, &pattern_length);
+    result = read_pattern(argv[2], &pattern, &pattern_mask, &pattern_length);
     if (result)
         return ERR_INVALID_PARAMETER;
 
     offset = strtol(argv[3], NULL, 10);
 
-    result = read_pattern(argv[4], &end_marker_pattern, &end_marker_length);
+    result = read_pattern(argv[4], &end_marker_pattern, NULL, &end_marker_length);
     if (result)
         return ERR_INVALID_PARAMETER;
     
@@ -199,5 +629,13 @@ int main(int argc, char* argv[])
 
     num_location = strtol(argv[6], NULL, 10);
 
-    return print_version(argv[1], buffer, end, pattern, pattern_length, offset, *end_marker_pattern, labs(max_length), num_location);
+    if (use_index && !ngram_attach(argv[7], &image, &index))
+    {
+        result = print_version(argv[1], buffer, end, pattern, pattern_mask, pattern_length, offset, *end_marker_pattern, labs(max_length), num_location, &index);
+        ngram_close(&index);
+        return finish_run(stats_file, result);
+    }
+
+    result = print_version(argv[1], buffer, end, pattern, pattern_mask, pattern_length, offset, *end_marker_pattern, labs(max_length), num_location, NULL);
+    return finish_run(stats_file, result);
 }
@@ -4,147 +4,524 @@
 #include <ctype.h>
 #include <stdint.h>
 
+#include "acmatch.h"
+#include "firmware.h"
+#include "image.h"
+#include "ngram.h"
+#include "pattern.h"
+#include "search.h"
+#include "stats.h"
+#include "trace.h"
+#include "threads.h"
+
 #define ERR_SUCCESS 0
 #define ERR_NOT_FOUND 1
 #define ERR_FILE_OPEN 2
 #define ERR_FILE_READ 3
 #define ERR_INVALID_PARAMETER 4
-#define ERR_OUT_OF_MEMORY 5;
+#define ERR_OUT_OF_MEMORY 5
 
-/* Implementation of GNU memmem function using Boyer-Moore-Horspool algorithm
-*  Returns pointer to the beginning of found pattern of NULL if not found */
-uint8_t* find_pattern(uint8_t* begin, uint8_t* end, const uint8_t* pattern, size_t plen)
+/* Reads list of patterns from file, one hex pattern per line
+*  Empty lines and lines starting with # are skipped */
+uint8_t read_pattern_file(const char* filename, char** text, char*** strings,
+                          uint8_t*** patterns, uint8_t*** masks, size_t** lengths, size_t* count)
 {
-    size_t scan = 0;
-    size_t bad_char_skip[256];
-    size_t last;
-    size_t slen;
+    FILE*  file;
+    long   filesize;
+    size_t i, lines;
+    char*  line;
+    char*  next;
+    char*  tail;
 
-    if (plen == 0 || !begin || !pattern || !end || end <= begin)
-        return NULL;
+    file = fopen(filename, "rb");
+    if (!file)
+        return ERR_FILE_OPEN;
 
-    slen = end - begin;
+    fseek(file, 0, SEEK_END);
+    filesize = ftell(file);
+    fseek(file, 0, SEEK_SET);
 
-    for (scan = 0; scan <= 255; scan++)
-        bad_char_skip[scan] = plen;
+    *text = (char*) malloc(filesize + 1);
+    if (!*text)
+    {
+        fclose(file);
+        return ERR_OUT_OF_MEMORY;
+    }
 
-    last = plen - 1;
+    if (fread(*text, sizeof(char), filesize, file) != (size_t) filesize)
+    {
+        fclose(file);
+        return ERR_FILE_READ;
+    }
+    fclose(file);
+    (*text)[filesize] = 0;
 
-    for (scan = 0; scan < last; scan++)
-        bad_char_skip[pattern[scan]] = last - scan;
+    /* Counting lines to size pattern arrays */
+    lines = 1;
+    for (i = 0; i < (size_t) filesize; i++)
+        if ((*text)[i] == '\n')
+            lines++;
 
-    while (slen >= plen)
+    *strings = (char**) malloc(lines * sizeof(char*));
+    *patterns = (uint8_t**) malloc(lines * sizeof(uint8_t*));
+    *masks = (uint8_t**) malloc(lines * sizeof(uint8_t*));
+    *lengths = (size_t*) malloc(lines * sizeof(size_t));
+    if (!*strings || !*patterns || !*masks || !*lengths)
+        return ERR_OUT_OF_MEMORY;
+
+    *count = 0;
+    for (line = *text; line; line = next)
     {
-        for (scan = last; begin[scan] == pattern[scan]; scan--)
-            if (scan == 0)
-                return begin;
+        next = strchr(line, '\n');
+        if (next)
+            *next++ = 0;
+
+        /* Trimming whitespace and CR of DOS line endings */
+        while (*line == ' ' || *line == '\t')
+            line++;
+        tail = line + strlen(line);
+        while (tail > line && isspace((unsigned char) tail[-1]))
+            *--tail = 0;
+
+        if (!*line || *line == '#')
+            continue;
 
-        slen     -= bad_char_skip[begin[last]];
-        begin   += bad_char_skip[begin[last]];
+        if (read_pattern(line, &(*patterns)[*count], &(*masks)[*count], &(*lengths)[*count]) || !(*lengths)[*count])
+        {
+            printf("Pattern %s can't be parsed as hex.\n", line);
+            return ERR_INVALID_PARAMETER;
+        }
+        (*strings)[(*count)++] = line;
     }
 
-    return NULL;
+    return ERR_SUCCESS;
 }
 
-uint8_t read_pattern(const char* string, uint8_t* pattern[], size_t* length)
-{
-    size_t  i;
-    const char* current;
-    char  buf[3];
+/* Parallel scan splits file into chunks, several per thread to balance padding
+*  against dense regions, but not smaller than CHUNK_MIN_SIZE */
+#define CHUNK_MIN_SIZE    (1024 * 1024)
+#define CHUNKS_PER_THREAD 4
 
-    buf[2] = 0;
+/* Work shared by threads of parallel scan */
+typedef struct
+{
+    const uint8_t* buffer;
+    const uint8_t* end;
+    size_t chunk_size;
+    size_t patterns;
+    compiled_pattern** compiled; /* Patterns not counted by automaton, NULL for others */
+    const ac_automaton* ac;      /* Literal patterns of multiple pattern mode */
+    unsigned long* counts;   /* Counts of every pattern for every chunk */
+    uint8_t failed;
+} scan_job;
 
-    *length = strlen(string);
-    if (*length % 2)
-        return ERR_INVALID_PARAMETER;
+/* Counts matches that end (automaton) or start (other patterns) inside chunk,
+*  so every match is counted exactly once over all chunks */
+static void scan_chunk(void* context, size_t index)
+{
+    scan_job* job = (scan_job*) context;
+    const uint8_t* begin = job->buffer + index * job->chunk_size;
+    const uint8_t* end = (size_t) (job->end - begin) > job->chunk_size ? begin + job->chunk_size : job->end;
+    const uint8_t* overlap_end;
+    unsigned long* counts = job->counts + index * job->patterns;
+    stats_mark mark;
+    trace_span span;
+    size_t length;
+    size_t i;
 
-    *length /= 2;
+    trace_begin(&span);
 
-    *pattern = (uint8_t*) malloc(*length);
+    /* Automaton is charged to the entry after the patterns, its matches to every pattern too,
+    *  every position of the chunk is a candidate of each of its patterns */
+    if (job->ac)
+    {
+        stats_begin(&mark);
+        if (ac_count(job->ac, job->buffer, begin, end, counts))
+            job->failed = 1;
+        stats_end(&mark, job->patterns);
+        if (stats_thread())
+            for (i = 0; i < job->patterns; i++)
+                if (!job->compiled[i])
+                    stats_add(i, 0, 0, (uint64_t) (end - begin), counts[i]);
+    }
 
-    for (current = string, i = 0; i < *length; i++)
+    for (i = 0; i < job->patterns; i++)
     {
-        buf[0] = *current++;
-        buf[1] = *current++;
+        if (!job->compiled[i])
+            continue;
 
-        if (!isxdigit(buf[0]) || !isxdigit(buf[1]))
-            return ERR_INVALID_PARAMETER;
-        else 
-            (*pattern)[i] = (uint8_t) strtoul(buf, NULL, 16);
+        /* Chunk overlaps the next one by length-1 bytes */
+        length = compiled_pattern_length(job->compiled[i]);
+        overlap_end = (size_t) (job->end - end) > length - 1 ? end + length - 1 : job->end;
+        stats_begin(&mark);
+        counts[i] = count_compiled(job->compiled[i], begin, overlap_end);
+        stats_end(&mark, i);
     }
+    trace_end(&span, "scan", "Chunk %lu, %lu bytes", (unsigned long) index, (unsigned long) (end - begin));
+}
 
-    return ERR_SUCCESS;
+/* Decompressed sections of firmware image, each one is counted as a single chunk */
+typedef struct
+{
+    const scan_job* scan;
+    const firmware_buffer* buffers;
+    unsigned long* counts;   /* Counts of every pattern for every buffer */
+    uint8_t failed;
+} buffer_job;
+
+static void scan_buffer(void* context, size_t index)
+{
+    buffer_job* job = (buffer_job*) context;
+    scan_job chunk = *job->scan;
+    trace_span span;
+
+    chunk.buffer = job->buffers[index].data;
+    chunk.end = chunk.buffer + job->buffers[index].size;
+    chunk.chunk_size = job->buffers[index].size;
+    chunk.counts = job->counts + index * chunk.patterns;
+    chunk.failed = 0;
+    trace_begin(&span);
+    scan_chunk(&chunk, 0);
+    trace_end(&span, "scan", "Section %lu", (unsigned long) index);
+    if (chunk.failed)
+        job->failed = 1;
+}
+
+/* Writes trace and statistics of the run, result of the run is kept unless they can't be written */
+static uint8_t finish_run(const char* stats_file, uint8_t result)
+{
+    uint8_t status;
+
+    status = trace_finish();
+    if (status == ERR_OUT_OF_MEMORY)
+        printf("Can't allocate memory for trace, some events are missing.\n");
+    else if (status)
+        printf("Can't write trace file.\n");
+    if (status)
+        result = status;
+
+    status = stats_report(stderr, stats_file);
+    if (status == ERR_FILE_OPEN)
+        printf("Statistics file can't be opened.\n");
+    else if (status)
+        printf("Can't allocate memory for statistics.\n");
+    return status ? status : result;
 }
 
 /* Entry point */
 int main(int argc, char* argv[])
 {
-    FILE*    file;
-    uint8_t* buffer;
-    uint8_t* end;
-    uint8_t* found;
-    uint8_t* pattern;
-    size_t length;
-    unsigned long count;
-    long filesize;
-    long read;
+    image_t  image;
+    uint8_t** patterns;
+    uint8_t** masks;
+    size_t*  lengths;
+    size_t*  literal_lengths;
+    char**   strings;
+    char*    text;
+    const char* stats_file;
+    const char* trace_file;
+    trace_span span;
+    size_t   count;
+    size_t   chunks;
+    size_t   i, j;
+    unsigned long* counts;
+    unsigned long total;
+    unsigned threads;
+    int      arg;
+    int      use_index;
+    int      decompress;
+    int      stats;
+    int      perf;
+    uint8_t* indexed;
+    size_t   literals;
+    scan_job job;
+    buffer_job buffers;
+    ac_automaton ac;
+    ngram_index index;
+    firmware_index firmware;
+    uint8_t result;
+
+    /* Parsing options */
+    threads = 1;
+    use_index = 0;
+    decompress = 0;
+    stats = 0;
+    perf = 0;
+    stats_file = NULL;
+    trace_file = NULL;
+    for (arg = 1; arg < argc; arg++)
+    {
+        if (argc - arg > 2 && !strcmp(argv[arg], "-j"))
+        {
+            threads = (unsigned) strtoul(argv[++arg], NULL, 10);
+            if (!threads)
+                threads = cpu_count();
+        }
+        else if (!strcmp(argv[arg], "-i"))
+            use_index = 1;
+        else if (!strcmp(argv[arg], "-d"))
+            decompress = 1;
+        else if (!strcmp(argv[arg], "--stats"))
+            stats = 1;
+        else if (!strcmp(argv[arg], "--perf-counters"))
+        {
+            stats = 1;
+            perf = 1;
+        }
+        else if (argc - arg > 1 && !strcmp(argv[arg], "--stats-json"))
+        {
+            stats = 1;
+            stats_file = argv[++arg];
+        }
+        else if (argc - arg > 1 && !strcmp(argv[arg], "--trace"))
+            trace_file = argv[++arg];
+        else
+            break;
+    }
     
-    if (argc < 3)
+    if (argc - arg < 2 || (argc - arg < 3 && !strcmp(argv[arg], "-f")))
     {
-        printf("hexfind v0.1.2\n\nUsage: hexfind PATTERN FILENAME\n");
+        printf("hexfind v0.4.0\n\n"
+            "Usage: hexfind [-j N] [-i] [-d] [--stats] [--stats-json FILE] [--perf-counters] [--trace FILE]\n"
+            "               PATTERN [PATTERN...] FILENAME\n"
+            "       hexfind [-j N] [-i] [-d] [--stats] [--stats-json FILE] [--perf-counters] [--trace FILE]\n"
+            "               -f PATTERNFILE FILENAME\n\n"
+            "With one PATTERN prints number of matches,\n"
+            "with many patterns or PATTERNFILE prints \"PATTERN count\" for every pattern.\n"
+            "PATTERNFILE holds one hex pattern per line, lines starting with # are skipped.\n"
+            "?? in PATTERN matches any byte, 4? or ?4 match one nibble.\n"
+            "-j N scans file on N threads, 0 means one thread per CPU.\n"
+            "-i looks patterns up in FILENAME" NGRAM_EXTENSION " index, building it if it is missing or stale.\n"
+            "-d also counts matches in compressed sections of firmware volumes, -i is ignored then.\n"
+            "--stats prints bytes scanned, searches, candidates and matches of every pattern\n"
+            "and time of every phase to stderr, --stats-json FILE writes them to FILE as JSON.\n"
+            "--perf-counters adds cycles, instructions, L1D and LLC misses and branch mispredictions\n"
+            "of the scan per byte scanned to statistics, where Linux offers them.\n"
+            "--trace FILE writes load of FILENAME and scan of every chunk and section on every thread\n"
+            "to FILE in Chrome trace event format.\n");
         return ERR_INVALID_PARAMETER;
     }
 
-    /* Parsing pattern string */
-    if (read_pattern(argv[1], &pattern, &length))
+    /* Parsing pattern strings */
+    if (!strcmp(argv[arg], "-f"))
     {
-        printf("Pattern can't be parsed as hex.\n");
-        return ERR_INVALID_PARAMETER;
+        result = read_pattern_file(argv[arg + 1], &text, &strings, &patterns, &masks, &lengths, &count);
+        if (result == ERR_FILE_OPEN)
+            printf("Pattern file can't be opened.\n");
+        else if (result == ERR_FILE_READ)
+            printf("Can't read pattern file.\n");
+        else if (result == ERR_OUT_OF_MEMORY)
+            printf("Can't allocate memory for patterns.\n");
+        if (result)
+            return result;
+        if (!count)
+        {
+            printf("Pattern file has no patterns.\n");
+            return ERR_INVALID_PARAMETER;
+        }
+    }
+    else
+    {
+        count = argc - arg - 1;
+        strings = argv + arg;
+        patterns = (uint8_t**) malloc(count * sizeof(uint8_t*));
+        masks = (uint8_t**) malloc(count * sizeof(uint8_t*));
+        lengths = (size_t*) malloc(count * sizeof(size_t));
+        if (!patterns || !masks || !lengths)
+        {
+            printf("Can't allocate memory for patterns.\n");
+            return ERR_OUT_OF_MEMORY;
+        }
+        for (i = 0; i < count; i++)
+        {
+            if (read_pattern(strings[i], &patterns[i], &masks[i], &lengths[i]))
+            {
+                printf("Pattern can't be parsed as hex.\n");
+                return ERR_INVALID_PARAMETER;
+            }
+        }
     }
 
-    /* Opening file */
-    file = fopen(argv[2], "rb");
-    if(!file)
+    /* Patterns are statistics entries, the automaton is the last one */
+    if (stats)
     {
-        printf("File can't be opened.\n");
+        if (stats_start(count + 1))
+        {
+            printf("Can't allocate memory for statistics.\n");
+            return ERR_OUT_OF_MEMORY;
+        }
+        if (perf && stats_perf())
+            fprintf(stderr, "Performance counters are not available, statistics are printed without them.\n");
+        for (i = 0; i < count; i++)
+            stats_name(i, strings[i]);
+        stats_name(count, "(automaton)");
+    }
+
+    if (trace_file && trace_start(trace_file))
+    {
+        printf("Trace file can't be opened.\n");
         return ERR_FILE_OPEN;
     }
 
-    /* Determining file size */
-    fseek(file, 0, SEEK_END);
-    filesize = ftell(file);
-    fseek(file, 0, SEEK_SET);
+    /* Mapping file */
+    stats_phase(STATS_LOAD);
+    trace_begin(&span);
+    result = load_image(argv[argc - 1], &image, IMAGE_READ_ONLY);
+    trace_end(&span, "load", "Load %s", argv[argc - 1]);
+    if (result == ERR_FILE_OPEN)
+        printf("File can't be opened.\n");
+    else if (result == ERR_OUT_OF_MEMORY)
+        printf("Can't allocate memory for file contents.\n");
+    else if (result)
+        printf("Can't read file.\n");
+    if (result)
+        return result;
 
-    /* Allocating memory for buffer */
-    buffer = (uint8_t*)malloc(filesize);
-    if (!buffer)
+    /* Splitting file into chunks */
+    memset(&job, 0, sizeof(job));
+    job.buffer = image.data;
+    job.end = image.data + image.size;
+    job.chunk_size = image.size;
+    job.patterns = count;
+    chunks = 1;
+    if (threads > 1 && image.size > CHUNK_MIN_SIZE)
     {
-        printf("Can't allocate memory for file contents.\n");
+        job.chunk_size = image.size / ((size_t) threads * CHUNKS_PER_THREAD);
+        if (job.chunk_size < CHUNK_MIN_SIZE)
+            job.chunk_size = CHUNK_MIN_SIZE;
+        chunks = (image.size + job.chunk_size - 1) / job.chunk_size;
+    }
+
+    counts = (unsigned long*) calloc(count, sizeof(unsigned long));
+    indexed = (uint8_t*) calloc(count, 1);
+    if (!counts || !indexed)
+    {
+        printf("Can't allocate memory for patterns.\n");
         return ERR_OUT_OF_MEMORY;
     }
-    
-    /* Reading whole file to buffer */
-    read = fread((void*)buffer, sizeof(char), filesize, file);
-    if (read != filesize)
+
+    /* Patterns found in the index are not scanned, index that can't be
+    *  opened or built leaves all of them to the scan */
+    stats_phase(STATS_SCAN);
+    if (use_index && !decompress && !ngram_attach(argv[argc - 1], &image, &index))
     {
-        printf("Can't read file.\n");
-        return ERR_FILE_READ;
+        for (i = 0; i < count; i++)
+            if (!ngram_count(&index, patterns[i], masks[i], lengths[i], &counts[i]))
+                indexed[i] = 1;
+        ngram_close(&index);
     }
-    
-    /* Searching for pattern in file and counting matches */
-    count = 0;
-    end = buffer + filesize;
-    found = find_pattern(buffer, end, pattern, length);
-    while (found)
+
+    /* Single pattern is counted directly, many literal patterns in one pass with automaton,
+    *  patterns with wildcards get zero length there and are counted separately */
+    stats_phase(STATS_COMPILE);
+    memset(&ac, 0, sizeof(ac));
+    if (argc - arg != 2)
     {
-        count++;
-        found = find_pattern(found + 1, end, pattern, length);
+        literal_lengths = (size_t*) malloc(count * sizeof(size_t));
+        if (!literal_lengths)
+        {
+            printf("Can't allocate memory for patterns.\n");
+            return ERR_OUT_OF_MEMORY;
+        }
+        literals = 0;
+        for (i = 0; i < count; i++)
+        {
+            literal_lengths[i] = masks[i] || indexed[i] ? 0 : lengths[i];
+            if (literal_lengths[i])
+                literals++;
+        }
+
+        if (literals && ac_build(&ac, patterns, literal_lengths, count))
+        {
+            printf("Can't allocate memory for patterns.\n");
+            return ERR_OUT_OF_MEMORY;
+        }
+        if (literals)
+            job.ac = &ac;
     }
 
-    if (count)
-        printf("%lu\n", count);
-    else
-        return ERR_NOT_FOUND;
-    
-    return ERR_SUCCESS;
+    /* Other patterns are compiled once and shared by all chunks */
+    job.compiled = (compiled_pattern**) calloc(count, sizeof(compiled_pattern*));
+    if (!job.compiled)
+    {
+        printf("Can't allocate memory for patterns.\n");
+        return ERR_OUT_OF_MEMORY;
+    }
+    for (i = 0; i < count; i++)
+    {
+        if ((job.ac && !masks[i]) || !lengths[i] || indexed[i])
+            continue;
+        job.compiled[i] = compile_pattern(patterns[i], masks[i], lengths[i]);
+        if (!job.compiled[i])
+        {
+            printf("Can't allocate memory for patterns.\n");
+            return ERR_OUT_OF_MEMORY;
+        }
+    }
+
+    job.counts = (unsigned long*) calloc(chunks * count, sizeof(unsigned long));
+    if (!job.counts)
+    {
+        printf("Can't allocate memory for patterns.\n");
+        return ERR_OUT_OF_MEMORY;
+    }
+
+    /* Searching for patterns in file and counting matches */
+    stats_phase(STATS_SCAN);
+    if (run_parallel(chunks, threads, scan_chunk, &job) || job.failed)
+    {
+        printf("Can't allocate memory for patterns.\n");
+        return ERR_OUT_OF_MEMORY;
+    }
+
+    total = 0;
+    for (i = 0; i < chunks; i++)
+        for (j = 0; j < count; j++)
+            counts[j] += job.counts[i * count + j];
+
+    /* Compressed sections are decompressed in memory and counted like the file */
+    if (decompress)
+    {
+        stats_phase(STATS_EXTRACT);
+        trace_begin(&span);
+        if (build_firmware_index(image.data, image.size, &firmware))
+        {
+            printf("Can't allocate memory for module index.\n");
+            return ERR_OUT_OF_MEMORY;
+        }
+        trace_end(&span, "firmware", "Decompress %lu sections", (unsigned long) firmware.buffer_count);
+        stats_phase(STATS_SCAN);
+        memset(&buffers, 0, sizeof(buffers));
+        buffers.scan = &job;
+        buffers.buffers = firmware.buffers;
+        buffers.counts = (unsigned long*) calloc(firmware.buffer_count * count + 1, sizeof(unsigned long));
+        if (!buffers.counts || run_parallel(firmware.buffer_count, threads, scan_buffer, &buffers) || buffers.failed)
+        {
+            printf("Can't allocate memory for patterns.\n");
+            return ERR_OUT_OF_MEMORY;
+        }
+        for (i = 0; i < firmware.buffer_count; i++)
+            for (j = 0; j < count; j++)
+                counts[j] += buffers.counts[i * count + j];
+        free(buffers.counts);
+        free_firmware_index(&firmware);
+    }
+    for (j = 0; j < count; j++)
+        total += counts[j];
+
+    stats_phase(STATS_PRINT);
+    if (argc - arg != 2)
+    {
+        for (i = 0; i < count; i++)
+            printf("%s %lu\n", strings[i], counts[i]);
+        ac_free(&ac);
+    }
+    else if (total)
+        printf("%lu\n", total);
+
+    for (i = 0; i < count; i++)
+        free_compiled_pattern(job.compiled[i]);
+    free(job.compiled);
+
+    return finish_run(stats_file, total ? ERR_SUCCESS : ERR_NOT_FOUND);
 }
@@ -0,0 +1,210 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "acmatch.h"
+#include "stats.h"
+
+#define AC_ALPHABET 256
+
+void ac_free(ac_automaton* ac)
+{
+    free(ac->next);
+    free(ac->fail);
+    free(ac->order);
+    free(ac->terminal);
+    free(ac->output);
+    free(ac->first);
+    free(ac->next_same);
+    free(ac->lengths);
+    memset(ac, 0, sizeof(*ac));
+}
+
+uint8_t ac_build(ac_automaton* ac, uint8_t* const patterns[],
+                 const size_t lengths[], size_t count)
+{
+    size_t i, j;
+    size_t total;
+    size_t head, tail;
+    uint32_t state, child, c;
+    uint32_t* row;
+    const uint32_t* fail_row;
+
+    memset(ac, 0, sizeof(*ac));
+
+    total = 1;
+    for (i = 0; i < count; i++)
+    {
+        total += lengths[i];
+        if (lengths[i] > ac->max_length)
+            ac->max_length = lengths[i];
+    }
+
+    ac->next = (uint32_t*) calloc(total * AC_ALPHABET, sizeof(uint32_t));
+    ac->fail = (uint32_t*) calloc(total, sizeof(uint32_t));
+    ac->order = (uint32_t*) malloc(total * sizeof(uint32_t));
+    ac->terminal = (uint32_t*) malloc((count ? count : 1) * sizeof(uint32_t));
+    ac->output = (uint32_t*) calloc(total, sizeof(uint32_t));
+    ac->first = (uint32_t*) calloc(total, sizeof(uint32_t));
+    ac->next_same = (uint32_t*) malloc((count ? count : 1) * sizeof(uint32_t));
+    ac->lengths = (size_t*) malloc((count ? count : 1) * sizeof(size_t));
+    if (!ac->next || !ac->fail || !ac->order || !ac->terminal ||
+        !ac->output || !ac->first || !ac->next_same || !ac->lengths)
+    {
+        ac_free(ac);
+        return 1;
+    }
+    ac->patterns = count;
+
+    /* Building trie, root is state 0 and is never a child, so 0 marks a missing edge */
+    ac->states = 1;
+    for (i = 0; i < count; i++)
+    {
+        state = 0;
+        for (j = 0; j < lengths[i]; j++)
+        {
+            child = ac->next[(size_t) state * AC_ALPHABET + patterns[i][j]];
+            if (!child)
+            {
+                child = (uint32_t) ac->states++;
+                ac->next[(size_t) state * AC_ALPHABET + patterns[i][j]] = child;
+            }
+            state = child;
+        }
+        ac->terminal[i] = state;
+        ac->lengths[i] = lengths[i];
+    }
+
+    /* Listing patterns of every terminal state in index order */
+    for (i = count; i > 0; i--)
+    {
+        state = ac->terminal[i - 1];
+        ac->next_same[i - 1] = state ? ac->first[state] : 0;
+        if (state)
+            ac->first[state] = (uint32_t) i;
+    }
+
+    /* Computing failure links breadth-first and filling missing transitions
+    *  with the transitions of the failure state */
+    head = tail = 0;
+    for (c = 0; c < AC_ALPHABET; c++)
+    {
+        child = ac->next[c];
+        if (child)
+            ac->order[tail++] = child;
+    }
+
+    while (head < tail)
+    {
+        state = ac->order[head++];
+        row = ac->next + (size_t) state * AC_ALPHABET;
+        fail_row = ac->next + (size_t) ac->fail[state] * AC_ALPHABET;
+        for (c = 0; c < AC_ALPHABET; c++)
+        {
+            child = row[c];
+            if (child)
+            {
+                ac->fail[child] = fail_row[c];
+                ac->order[tail++] = child;
+            }
+            else
+                row[c] = fail_row[c];
+        }
+
+        /* Failure state is closer to the root, so its output is already known */
+        ac->output[state] = ac->first[state] ? state : ac->output[ac->fail[state]];
+    }
+
+    return 0;
+}
+
+uint8_t ac_count(const ac_automaton* ac, const uint8_t* buffer, const uint8_t* begin,
+                 const uint8_t* end, unsigned long counts[])
+{
+    unsigned long* visits;
+    const uint32_t* next = ac->next;
+    const uint8_t* current;
+    stats_counters* stats = stats_thread();
+    uint32_t state;
+    size_t i;
+
+    visits = (unsigned long*) calloc(ac->states, sizeof(unsigned long));
+    if (!visits)
+        return 1;
+    if (stats)
+    {
+        stats->calls++;
+        stats->bytes += begin && end > begin ? (uint64_t) (end - begin) : 0;
+        stats->candidates += begin && end > begin ? (uint64_t) (end - begin) : 0;
+    }
+
+    state = 0;
+    if (begin && end > begin)
+    {
+        /* Reaching the state of begin from the preceding bytes,
+        *  automaton state never depends on more than max_length-1 of them */
+        current = begin;
+        if (ac->max_length > 1)
+            current = (size_t) (begin - buffer) > ac->max_length - 1 ? begin - (ac->max_length - 1) : buffer;
+        for (; current < begin; current++)
+            state = next[(size_t) state * AC_ALPHABET + *current];
+
+        /* Counting visits of every state, a pattern ends at each visit of its
+        *  terminal state or of any state whose failure chain passes through it */
+        for (; begin < end; begin++)
+        {
+            state = next[(size_t) state * AC_ALPHABET + *begin];
+            visits[state]++;
+        }
+    }
+
+    /* Accumulating visits along failure links, deepest states first */
+    for (i = ac->states - 1; i > 0; i--)
+    {
+        state = ac->order[i - 1];
+        visits[ac->fail[state]] += visits[state];
+    }
+
+    for (i = 0; i < ac->patterns; i++)
+    {
+        counts[i] = ac->terminal[i] ? visits[ac->terminal[i]] : 0;
+        if (stats)
+            stats->matches += counts[i];
+    }
+
+    free(visits);
+    return 0;
+}
+
+void ac_scan(const ac_automaton* ac, const uint8_t* begin, const uint8_t* end,
+             ac_callback callback, void* context)
+{
+    const uint32_t* next = ac->next;
+    const uint8_t* start = begin;
+    stats_counters* stats = stats_thread();
+    uint32_t state, match, pattern;
+    int stop = 0;
+
+    if (!begin || end <= begin)
+        return;
+
+    state = 0;
+    for (; begin < end && !stop; begin++)
+    {
+        state = next[(size_t) state * AC_ALPHABET + *begin];
+        for (match = ac->output[state]; match && !stop; match = ac->output[ac->fail[match]])
+            for (pattern = ac->first[match]; pattern && !stop; pattern = ac->next_same[pattern - 1])
+            {
+                if (stats)
+                    stats->matches++;
+                stop = callback(context, pattern - 1, begin + 1 - ac->lengths[pattern - 1]);
+            }
+    }
+
+    /* Bytes up to the stop are counted, each of them is a candidate of every pattern */
+    if (stats)
+    {
+        stats->calls++;
+        stats->bytes += (uint64_t) (begin - start);
+        stats->candidates += (uint64_t) (begin - start);
+    }
+}
@@ -0,0 +1,49 @@
+#ifndef ACMATCH_H
+#define ACMATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Aho-Corasick automaton for a set of byte patterns
+*  Transitions are fully resolved, so a scan is one table lookup per byte */
+typedef struct
+{
+    uint32_t* next;      /* Transition table, 256 entries per state */
+    uint32_t* fail;      /* Failure link of every state */
+    uint32_t* order;     /* Non-root states in breadth-first order */
+    uint32_t* terminal;  /* State reached by every pattern, 0 for empty ones */
+    uint32_t* output;    /* Nearest state on failure chain, the state itself included,
+                            where a pattern ends, 0 if none */
+    uint32_t* first;     /* First pattern ending in every state plus 1, 0 if none */
+    uint32_t* next_same; /* Next pattern with the same terminal state plus 1, 0 if none */
+    size_t*   lengths;
+    size_t    states;
+    size_t    patterns;
+    size_t    max_length;
+} ac_automaton;
+
+/* Builds automaton for count patterns
+*  Returns 0 on success or 1 if memory can't be allocated */
+uint8_t ac_build(ac_automaton* ac, uint8_t* const patterns[],
+                 const size_t lengths[], size_t count);
+
+/* Counts all (overlapping) occurrences of every pattern that end between begin and end,
+*  up to max_length-1 bytes before begin, but not before buffer, are read to
+*  catch matches that start earlier, so adjacent ranges can be counted separately.
+*  Returns 0 on success or 1 if memory can't be allocated */
+uint8_t ac_count(const ac_automaton* ac, const uint8_t* buffer, const uint8_t* begin,
+                 const uint8_t* end, unsigned long counts[]);
+
+/* Called for every match with pattern index and its first byte,
+*  nonzero return stops the scan */
+typedef int (*ac_callback)(void* context, size_t pattern, const uint8_t* match);
+
+/* Reports all (overlapping) occurrences of every pattern between begin and end
+*  in order of their last bytes, patterns ending at the same byte in index order */
+void ac_scan(const ac_automaton* ac, const uint8_t* begin, const uint8_t* end,
+             ac_callback callback, void* context);
+
+/* Frees memory used by automaton */
+void ac_free(ac_automaton* ac);
+
+#endif
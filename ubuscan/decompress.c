@@ -0,0 +1,825 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "decompress.h"
+
+/* Sliding window of output, blocks go to the sink every time it fills up,
+*  so memory stays at window size however long the output is */
+typedef struct
+{
+    uint8_t* data;
+    size_t   size;
+    size_t   position;     /* Next byte is written here */
+    uint8_t  full;         /* Window wrapped at least once */
+    uint8_t  stopped;      /* Sink asked to stop */
+    uint64_t total;        /* Bytes written */
+    decompress_sink sink;
+    void*    context;
+} output_window;
+
+static uint8_t open_window(output_window* window, size_t size, decompress_sink sink, void* context)
+{
+    memset(window, 0, sizeof(output_window));
+    window->data = (uint8_t*) malloc(size ? size : 1);
+    if (!window->data)
+        return DECOMPRESS_ERR_OUT_OF_MEMORY;
+    window->size = size;
+    window->sink = sink;
+    window->context = context;
+    return DECOMPRESS_SUCCESS;
+}
+
+/* Passes bytes written since the last flush to sink */
+static int flush_window(output_window* window)
+{
+    if (window->position && window->sink && window->sink(window->context, window->data, window->position))
+        window->stopped = 1;
+    if (window->position == window->size)
+    {
+        window->position = 0;
+        window->full = 1;
+    }
+    return window->stopped;
+}
+
+static int put_byte(output_window* window, uint8_t byte)
+{
+    window->data[window->position++] = byte;
+    window->total++;
+    return window->position == window->size ? flush_window(window) : 0;
+}
+
+/* Byte written distance bytes ago, distance is checked by caller */
+static uint8_t get_byte(const output_window* window, size_t distance)
+{
+    if (window->position >= distance)
+        return window->data[window->position - distance];
+    return window->data[window->size - distance + window->position];
+}
+
+static int distance_valid(const output_window* window, uint64_t distance)
+{
+    return distance && (distance <= window->position || (window->full && distance <= window->size));
+}
+
+static void close_window(output_window* window)
+{
+    free(window->data);
+    window->data = NULL;
+}
+
+static uint32_t read_dword(const uint8_t* data)
+{
+    return (uint32_t) data[0] | ((uint32_t) data[1] << 8) | ((uint32_t) data[2] << 16) | ((uint32_t) data[3] << 24);
+}
+
+/* EFI and Tiano streams: header with compressed and original sizes, then blocks
+*  of LZ77 literals and matches coded with three canonical Huffman codes read from
+*  the start of every block: extra code (T) for lengths of the char and length code (C),
+*  and position code (P). Both formats differ only in width of position code count */
+#define EFI_HEADER_SIZE  8
+#define EFI_NC           510 /* 256 literals and match lengths 3 to 256 */
+#define EFI_NT           19
+#define EFI_NP           31
+#define EFI_CBIT         9
+#define EFI_TBIT         5
+#define EFI_PBIT_EFI     4
+#define EFI_PBIT_TIANO   5
+#define EFI_THRESHOLD    3
+#define EFI_CTABLE_BITS  12
+#define EFI_PTABLE_BITS  8
+#define EFI_MAX_CODE_LENGTH 16
+
+/* Tiano compressor keeps a 512 KB window, positions past 1 MB are taken as damage */
+#define EFI_WINDOW_MAX   (1 << 20)
+
+/* Table entry of code longer than the table, decoded bit by bit */
+#define HUFFMAN_LONG 0xFFFF
+
+typedef struct
+{
+    const uint8_t* data;
+    size_t   size;
+    size_t   position;   /* Next byte to load, bytes past the end read as zeroes */
+    uint32_t bits;       /* Loaded bits, first one in the highest bit */
+    unsigned available;
+} bit_reader;
+
+typedef struct
+{
+    int      single;                       /* Symbol of code without bits, -1 for others */
+    unsigned table_bits;
+    uint16_t count[EFI_MAX_CODE_LENGTH + 1];
+    uint16_t symbols[EFI_NC];              /* Sorted by code */
+    uint16_t table[1 << EFI_CTABLE_BITS];  /* Symbol << 5 | length */
+} huffman_code;
+
+typedef struct
+{
+    bit_reader   reader;
+    huffman_code t_code;
+    huffman_code c_code;
+    huffman_code p_code;
+    uint8_t      lengths[EFI_NC];
+} efi_decoder;
+
+static void refill_bits(bit_reader* reader)
+{
+    uint32_t byte;
+
+    while (reader->available <= 24)
+    {
+        byte = reader->position < reader->size ? reader->data[reader->position] : 0;
+        reader->position++;
+        reader->bits |= byte << (24 - reader->available);
+        reader->available += 8;
+    }
+}
+
+/* Next 16 bits without consuming them */
+static uint32_t peek_bits(bit_reader* reader)
+{
+    refill_bits(reader);
+    return reader->bits >> 16;
+}
+
+static void drop_bits(bit_reader* reader, unsigned count)
+{
+    reader->bits <<= count;
+    reader->available -= count;
+}
+
+static uint32_t get_bits(bit_reader* reader, unsigned count)
+{
+    uint32_t value;
+
+    if (!count)
+        return 0;
+    refill_bits(reader);
+    value = reader->bits >> (32 - count);
+    drop_bits(reader, count);
+    return value;
+}
+
+/* Reads past the end of compressed data mean the stream is damaged */
+static int reader_overrun(const bit_reader* reader)
+{
+    return (uint64_t) reader->position * 8 - reader->available > (uint64_t) reader->size * 8;
+}
+
+/* Builds canonical code from lengths, returns nonzero if they don't form a complete code */
+static int build_code(huffman_code* code, const uint8_t* lengths, size_t count, unsigned table_bits)
+{
+    uint16_t offsets[EFI_MAX_CODE_LENGTH + 2];
+    uint32_t space = 0, next = 0, entry, last;
+    size_t symbol, i;
+    unsigned length;
+
+    code->single = -1;
+    code->table_bits = table_bits;
+    memset(code->count, 0, sizeof(code->count));
+    for (symbol = 0; symbol < count; symbol++)
+    {
+        if (lengths[symbol] > EFI_MAX_CODE_LENGTH)
+            return 1;
+        code->count[lengths[symbol]]++;
+    }
+    code->count[0] = 0;
+    for (length = 1; length <= EFI_MAX_CODE_LENGTH; length++)
+        space += (uint32_t) code->count[length] << (EFI_MAX_CODE_LENGTH - length);
+    if (space != 1U << EFI_MAX_CODE_LENGTH)
+        return 1;
+
+    offsets[1] = 0;
+    for (length = 1; length <= EFI_MAX_CODE_LENGTH; length++)
+        offsets[length + 1] = (uint16_t) (offsets[length] + code->count[length]);
+    for (symbol = 0; symbol < count; symbol++)
+        if (lengths[symbol])
+            code->symbols[offsets[lengths[symbol]]++] = (uint16_t) symbol;
+
+    /* Short codes fill all table entries they are a prefix of */
+    for (i = 0; i < ((size_t) 1 << table_bits); i++)
+        code->table[i] = HUFFMAN_LONG;
+    symbol = 0;
+    for (length = 1; length <= table_bits; length++)
+    {
+        for (i = 0; i < code->count[length]; i++, next++, symbol++)
+        {
+            last = (next + 1) << (table_bits - length);
+            for (entry = next << (table_bits - length); entry < last; entry++)
+                code->table[entry] = (uint16_t) (code->symbols[symbol] << 5 | length);
+        }
+        next <<= 1;
+    }
+    return 0;
+}
+
+static uint16_t decode_symbol(bit_reader* reader, const huffman_code* code)
+{
+    uint32_t bits, value, first = 0, index = 0;
+    uint16_t entry;
+    unsigned length;
+
+    if (code->single >= 0)
+        return (uint16_t) code->single;
+
+    bits = peek_bits(reader);
+    entry = code->table[bits >> (EFI_MAX_CODE_LENGTH - code->table_bits)];
+    if (entry != HUFFMAN_LONG)
+    {
+        drop_bits(reader, entry & 0x1F);
+        return (uint16_t) (entry >> 5);
+    }
+
+    /* Codes are complete, so one of the lengths matches */
+    for (length = 1; length <= EFI_MAX_CODE_LENGTH; length++)
+    {
+        value = bits >> (EFI_MAX_CODE_LENGTH - length);
+        if (value - first < code->count[length])
+            break;
+        index += code->count[length];
+        first = (first + code->count[length]) << 1;
+    }
+    drop_bits(reader, length);
+    return code->symbols[index + value - first];
+}
+
+/* Lengths of extra or position code: 3 bits, 7 continued in unary.
+*  After special number of lengths a 2-bit count of zero lengths follows */
+static int read_pt_lengths(efi_decoder* decoder, huffman_code* code, size_t count, unsigned count_bits, size_t special)
+{
+    bit_reader* reader = &decoder->reader;
+    uint32_t number, bits, mask, zeroes;
+    unsigned length;
+    size_t i = 0;
+
+    number = get_bits(reader, count_bits);
+    if (!number)
+    {
+        number = get_bits(reader, count_bits);
+        if (number >= count)
+            return 1;
+        code->single = (int) number;
+        return 0;
+    }
+    if (number > count)
+        return 1;
+
+    while (i < number)
+    {
+        bits = peek_bits(reader);
+        length = bits >> 13;
+        if (length == 7)
+        {
+            for (mask = 1 << 12; mask && (bits & mask); mask >>= 1)
+                length++;
+            if (length > EFI_MAX_CODE_LENGTH)
+                return 1;
+        }
+        drop_bits(reader, length < 7 ? 3 : length - 3);
+        decoder->lengths[i++] = (uint8_t) length;
+
+        if (i == special)
+        {
+            zeroes = get_bits(reader, 2);
+            while (zeroes-- && i < count)
+                decoder->lengths[i++] = 0;
+        }
+    }
+    while (i < count)
+        decoder->lengths[i++] = 0;
+    return build_code(code, decoder->lengths, count, EFI_PTABLE_BITS);
+}
+
+/* Lengths of char and length code, coded with extra code, 0 to 2 stand for runs of zeroes */
+static int read_c_lengths(efi_decoder* decoder)
+{
+    bit_reader* reader = &decoder->reader;
+    uint32_t number, zeroes;
+    uint16_t symbol;
+    size_t i = 0;
+
+    number = get_bits(reader, EFI_CBIT);
+    if (!number)
+    {
+        number = get_bits(reader, EFI_CBIT);
+        if (number >= EFI_NC)
+            return 1;
+        decoder->c_code.single = (int) number;
+        return 0;
+    }
+    if (number > EFI_NC)
+        return 1;
+
+    while (i < number)
+    {
+        symbol = decode_symbol(reader, &decoder->t_code);
+        if (symbol > 2)
+        {
+            decoder->lengths[i++] = (uint8_t) (symbol - 2);
+            continue;
+        }
+        if (symbol == 0)
+            zeroes = 1;
+        else if (symbol == 1)
+            zeroes = get_bits(reader, 4) + 3;
+        else
+            zeroes = get_bits(reader, EFI_CBIT) + 20;
+        while (zeroes-- && i < EFI_NC)
+            decoder->lengths[i++] = 0;
+    }
+    while (i < EFI_NC)
+        decoder->lengths[i++] = 0;
+    return build_code(&decoder->c_code, decoder->lengths, EFI_NC, EFI_CTABLE_BITS);
+}
+
+/* Match distance minus one: code is the bit length, lower bits follow as they are */
+static uint32_t decode_position(efi_decoder* decoder)
+{
+    bit_reader* reader = &decoder->reader;
+    uint16_t bits = decode_symbol(reader, &decoder->p_code);
+    uint32_t value;
+
+    if (bits <= 1)
+        return bits;
+    bits--;
+
+    /* Wide positions are read in two parts */
+    if (bits > 16)
+    {
+        value = get_bits(reader, bits - 16) << 16;
+        value |= get_bits(reader, 16);
+    }
+    else
+        value = get_bits(reader, bits);
+    return ((uint32_t) 1 << bits) + value;
+}
+
+static uint8_t decompress_efi(const uint8_t* data, size_t size, unsigned position_bits,
+                              decompress_sink sink, void* context)
+{
+    efi_decoder* decoder;
+    output_window window;
+    uint32_t compressed, original, block = 0, distance, length;
+    uint16_t symbol;
+    uint8_t result = DECOMPRESS_SUCCESS;
+
+    if (size < EFI_HEADER_SIZE)
+        return DECOMPRESS_ERR_CORRUPT;
+    compressed = read_dword(data);
+    original = read_dword(data + 4);
+    if (compressed > size - EFI_HEADER_SIZE)
+        return DECOMPRESS_ERR_CORRUPT;
+    if (!original)
+        return DECOMPRESS_SUCCESS;
+
+    decoder = (efi_decoder*) calloc(1, sizeof(efi_decoder));
+    if (!decoder)
+        return DECOMPRESS_ERR_OUT_OF_MEMORY;
+    if (open_window(&window, original < EFI_WINDOW_MAX ? original : EFI_WINDOW_MAX, sink, context))
+    {
+        free(decoder);
+        return DECOMPRESS_ERR_OUT_OF_MEMORY;
+    }
+    decoder->reader.data = data + EFI_HEADER_SIZE;
+    decoder->reader.size = compressed;
+
+    while (window.total < original && !window.stopped)
+    {
+        /* Every block starts with its symbol count and codes, zero count means 65536 */
+        if (!block)
+        {
+            block = get_bits(&decoder->reader, 16);
+            if (!block)
+                block = 0x10000;
+            if (read_pt_lengths(decoder, &decoder->t_code, EFI_NT, EFI_TBIT, 3) || read_c_lengths(decoder) ||
+                read_pt_lengths(decoder, &decoder->p_code, EFI_NP, position_bits, (size_t) -1) ||
+                reader_overrun(&decoder->reader))
+            {
+                result = DECOMPRESS_ERR_CORRUPT;
+                break;
+            }
+        }
+        block--;
+
+        symbol = decode_symbol(&decoder->reader, &decoder->c_code);
+        if (symbol < 256)
+        {
+            put_byte(&window, (uint8_t) symbol);
+            continue;
+        }
+
+        length = symbol - (256 - EFI_THRESHOLD);
+        distance = decode_position(decoder) + 1;
+        if (!distance_valid(&window, distance))
+        {
+            result = DECOMPRESS_ERR_CORRUPT;
+            break;
+        }
+        while (length-- && window.total < original && !window.stopped)
+            put_byte(&window, get_byte(&window, distance));
+    }
+
+    if (!result && reader_overrun(&decoder->reader))
+        result = DECOMPRESS_ERR_CORRUPT;
+    if (!result && !window.stopped)
+        flush_window(&window);
+    if (!result && window.stopped)
+        result = DECOMPRESS_ERR_STOPPED;
+    close_window(&window);
+    free(decoder);
+    return result;
+}
+
+/* LZMA streams: properties byte, dictionary size and 64-bit unpacked size,
+*  then range coded literals and matches as in the reference decoder of LZMA SDK */
+#define LZMA_HEADER_SIZE        13
+#define LZMA_MIN_DICTIONARY     (1 << 12)
+#define LZMA_MAX_WINDOW         (64 * 1024 * 1024)
+#define LZMA_PROB_BITS          11
+#define LZMA_PROB_INIT          (1 << (LZMA_PROB_BITS - 1))
+#define LZMA_MOVE_BITS          5
+#define LZMA_TOP                (1 << 24)
+#define LZMA_STATES             12
+#define LZMA_POS_STATES_MAX     16
+#define LZMA_LEN_TO_POS_STATES  4
+#define LZMA_ALIGN_BITS         4
+#define LZMA_END_POS_MODEL      14
+#define LZMA_FULL_DISTANCES     128
+#define LZMA_MATCH_MIN          2
+
+typedef struct
+{
+    const uint8_t* data;
+    size_t   size;
+    size_t   position;
+    uint32_t range;
+    uint32_t code;
+    uint8_t  corrupt;
+} range_decoder;
+
+typedef struct
+{
+    uint16_t choice;
+    uint16_t choice2;
+    uint16_t low[LZMA_POS_STATES_MAX][1 << 3];
+    uint16_t mid[LZMA_POS_STATES_MAX][1 << 3];
+    uint16_t high[1 << 8];
+} length_decoder;
+
+typedef struct
+{
+    range_decoder  range;
+    unsigned       lc, lp, pb;
+    uint32_t       dictionary;
+    uint16_t*      literals;
+    uint16_t       pos_slot[LZMA_LEN_TO_POS_STATES][1 << 6];
+    uint16_t       pos_decoders[1 + LZMA_FULL_DISTANCES - LZMA_END_POS_MODEL];
+    uint16_t       align[1 << LZMA_ALIGN_BITS];
+    uint16_t       is_match[LZMA_STATES << 4];
+    uint16_t       is_rep[LZMA_STATES];
+    uint16_t       is_rep_g0[LZMA_STATES];
+    uint16_t       is_rep_g1[LZMA_STATES];
+    uint16_t       is_rep_g2[LZMA_STATES];
+    uint16_t       is_rep0_long[LZMA_STATES << 4];
+    length_decoder length;
+    length_decoder rep_length;
+} lzma_decoder;
+
+static uint8_t next_byte(range_decoder* range)
+{
+    if (range->position < range->size)
+        return range->data[range->position++];
+    range->corrupt = 1;
+    return 0;
+}
+
+static void normalize_range(range_decoder* range)
+{
+    if (range->range < LZMA_TOP)
+    {
+        range->range <<= 8;
+        range->code = (range->code << 8) | next_byte(range);
+    }
+}
+
+static unsigned decode_bit(range_decoder* range, uint16_t* probability)
+{
+    uint32_t bound = (range->range >> LZMA_PROB_BITS) * *probability;
+    unsigned bit;
+
+    if (range->code < bound)
+    {
+        *probability = (uint16_t) (*probability + (((1 << LZMA_PROB_BITS) - *probability) >> LZMA_MOVE_BITS));
+        range->range = bound;
+        bit = 0;
+    }
+    else
+    {
+        *probability = (uint16_t) (*probability - (*probability >> LZMA_MOVE_BITS));
+        range->code -= bound;
+        range->range -= bound;
+        bit = 1;
+    }
+    normalize_range(range);
+    return bit;
+}
+
+static uint32_t decode_direct_bits(range_decoder* range, unsigned count)
+{
+    uint32_t value = 0, mask;
+
+    while (count--)
+    {
+        range->range >>= 1;
+        range->code -= range->range;
+        mask = 0 - (range->code >> 31);
+        range->code += range->range & mask;
+        if (range->code == range->range)
+            range->corrupt = 1;
+        normalize_range(range);
+        value = (value << 1) + (mask + 1);
+    }
+    return value;
+}
+
+static unsigned decode_tree(range_decoder* range, uint16_t* probabilities, unsigned bits)
+{
+    unsigned symbol = 1, i;
+
+    for (i = 0; i < bits; i++)
+        symbol = (symbol << 1) + decode_bit(range, &probabilities[symbol]);
+    return symbol - (1U << bits);
+}
+
+static unsigned decode_reverse_tree(range_decoder* range, uint16_t* probabilities, unsigned bits)
+{
+    unsigned symbol = 1, value = 0, bit, i;
+
+    for (i = 0; i < bits; i++)
+    {
+        bit = decode_bit(range, &probabilities[symbol]);
+        symbol = (symbol << 1) + bit;
+        value |= bit << i;
+    }
+    return value;
+}
+
+static unsigned decode_length(range_decoder* range, length_decoder* length, unsigned pos_state)
+{
+    if (!decode_bit(range, &length->choice))
+        return decode_tree(range, length->low[pos_state], 3);
+    if (!decode_bit(range, &length->choice2))
+        return 8 + decode_tree(range, length->mid[pos_state], 3);
+    return 16 + decode_tree(range, length->high, 8);
+}
+
+static uint32_t decode_distance(lzma_decoder* decoder, unsigned length)
+{
+    range_decoder* range = &decoder->range;
+    unsigned state = length < LZMA_LEN_TO_POS_STATES - 1 ? length : LZMA_LEN_TO_POS_STATES - 1;
+    unsigned slot, direct;
+    uint32_t distance;
+
+    slot = decode_tree(range, decoder->pos_slot[state], 6);
+    if (slot < 4)
+        return slot;
+
+    direct = (slot >> 1) - 1;
+    distance = (2 | (slot & 1)) << direct;
+    if (slot < LZMA_END_POS_MODEL)
+        return distance + decode_reverse_tree(range, decoder->pos_decoders + distance - slot, direct);
+    distance += decode_direct_bits(range, direct - LZMA_ALIGN_BITS) << LZMA_ALIGN_BITS;
+    return distance + decode_reverse_tree(range, decoder->align, LZMA_ALIGN_BITS);
+}
+
+static void init_probabilities(uint16_t* probabilities, size_t count)
+{
+    size_t i;
+
+    for (i = 0; i < count; i++)
+        probabilities[i] = LZMA_PROB_INIT;
+}
+
+static void decode_literal(lzma_decoder* decoder, output_window* window, unsigned state, uint32_t rep0)
+{
+    range_decoder* range = &decoder->range;
+    uint16_t* probabilities;
+    unsigned previous, symbol = 1, match, match_bit, bit;
+    size_t literal_state;
+
+    previous = window->total ? get_byte(window, 1) : 0;
+    literal_state = ((size_t) (window->total & ((1U << decoder->lp) - 1)) << decoder->lc) + (previous >> (8 - decoder->lc));
+    probabilities = decoder->literals + 0x300 * literal_state;
+
+    /* After a match the literal is coded against the byte at rep0 */
+    if (state >= 7)
+    {
+        match = get_byte(window, rep0 + 1);
+        do
+        {
+            match_bit = (match >> 7) & 1;
+            match <<= 1;
+            bit = decode_bit(range, &probabilities[((1 + match_bit) << 8) + symbol]);
+            symbol = (symbol << 1) | bit;
+            if (match_bit != bit)
+                break;
+        } while (symbol < 0x100);
+    }
+    while (symbol < 0x100)
+        symbol = (symbol << 1) | decode_bit(range, &probabilities[symbol]);
+    put_byte(window, (uint8_t) (symbol - 0x100));
+}
+
+static uint8_t decompress_lzma(const uint8_t* data, size_t size, decompress_sink sink, void* context)
+{
+    lzma_decoder* decoder;
+    output_window window;
+    range_decoder* range;
+    uint64_t unpacked, left;
+    uint32_t rep0 = 0, rep1 = 0, rep2 = 0, rep3 = 0, distance;
+    unsigned properties, state = 0, pos_state, length;
+    size_t window_size, i;
+    uint8_t result = DECOMPRESS_SUCCESS, known;
+
+    if (size < LZMA_HEADER_SIZE || data[0] >= 9 * 5 * 5)
+        return DECOMPRESS_ERR_CORRUPT;
+    unpacked = decompressed_size(DECOMPRESS_LZMA, data, size);
+    known = unpacked != DECOMPRESS_UNKNOWN_SIZE;
+    if (known && !unpacked)
+        return DECOMPRESS_SUCCESS;
+
+    decoder = (lzma_decoder*) calloc(1, sizeof(lzma_decoder));
+    if (!decoder)
+        return DECOMPRESS_ERR_OUT_OF_MEMORY;
+    properties = data[0];
+    decoder->lc = properties % 9;
+    properties /= 9;
+    decoder->lp = properties % 5;
+    decoder->pb = properties / 5;
+    decoder->dictionary = read_dword(data + 1);
+
+    /* Window is the dictionary, but never more than the whole output */
+    window_size = decoder->dictionary < LZMA_MIN_DICTIONARY ? LZMA_MIN_DICTIONARY : decoder->dictionary;
+    if (known && unpacked < window_size)
+        window_size = (size_t) unpacked;
+    decoder->literals = (uint16_t*) malloc(((size_t) 0x300 << (decoder->lc + decoder->lp)) * sizeof(uint16_t));
+    if (window_size > LZMA_MAX_WINDOW || !decoder->literals || open_window(&window, window_size, sink, context))
+    {
+        free(decoder->literals);
+        free(decoder);
+        return DECOMPRESS_ERR_OUT_OF_MEMORY;
+    }
+
+    init_probabilities(decoder->literals, (size_t) 0x300 << (decoder->lc + decoder->lp));
+    init_probabilities(&decoder->pos_slot[0][0], sizeof(decoder->pos_slot) / sizeof(uint16_t));
+    init_probabilities(decoder->pos_decoders, sizeof(decoder->pos_decoders) / sizeof(uint16_t));
+    init_probabilities(decoder->align, sizeof(decoder->align) / sizeof(uint16_t));
+    init_probabilities(decoder->is_match, sizeof(decoder->is_match) / sizeof(uint16_t));
+    init_probabilities(decoder->is_rep, sizeof(decoder->is_rep) / sizeof(uint16_t));
+    init_probabilities(decoder->is_rep_g0, sizeof(decoder->is_rep_g0) / sizeof(uint16_t));
+    init_probabilities(decoder->is_rep_g1, sizeof(decoder->is_rep_g1) / sizeof(uint16_t));
+    init_probabilities(decoder->is_rep_g2, sizeof(decoder->is_rep_g2) / sizeof(uint16_t));
+    init_probabilities(decoder->is_rep0_long, sizeof(decoder->is_rep0_long) / sizeof(uint16_t));
+    init_probabilities(&decoder->length.choice, sizeof(length_decoder) / sizeof(uint16_t));
+    init_probabilities(&decoder->rep_length.choice, sizeof(length_decoder) / sizeof(uint16_t));
+
+    range = &decoder->range;
+    range->data = data + LZMA_HEADER_SIZE;
+    range->size = size - LZMA_HEADER_SIZE;
+    range->range = 0xFFFFFFFF;
+    if (next_byte(range))
+        range->corrupt = 1;
+    for (i = 0; i < 4; i++)
+        range->code = (range->code << 8) | next_byte(range);
+    if (range->code == range->range)
+        range->corrupt = 1;
+
+    left = unpacked;
+    while (!range->corrupt && !window.stopped)
+    {
+        /* Stream of known size may end without end marker */
+        if (known && !left && !range->code)
+            break;
+
+        pos_state = (unsigned) (window.total & ((1U << decoder->pb) - 1));
+        if (!decode_bit(range, &decoder->is_match[(state << 4) + pos_state]))
+        {
+            if (known && !left)
+            {
+                range->corrupt = 1;
+                break;
+            }
+            decode_literal(decoder, &window, state, rep0);
+            state = state < 4 ? 0 : (state < 10 ? state - 3 : state - 6);
+            left--;
+            continue;
+        }
+
+        if (decode_bit(range, &decoder->is_rep[state]))
+        {
+            if ((known && !left) || !window.total)
+            {
+                range->corrupt = 1;
+                break;
+            }
+            if (!decode_bit(range, &decoder->is_rep_g0[state]))
+            {
+                /* Short rep: one byte from rep0 */
+                if (!decode_bit(range, &decoder->is_rep0_long[(state << 4) + pos_state]))
+                {
+                    state = state < 7 ? 9 : 11;
+                    put_byte(&window, get_byte(&window, rep0 + 1));
+                    left--;
+                    continue;
+                }
+            }
+            else
+            {
+                if (!decode_bit(range, &decoder->is_rep_g1[state]))
+                    distance = rep1;
+                else
+                {
+                    if (!decode_bit(range, &decoder->is_rep_g2[state]))
+                        distance = rep2;
+                    else
+                    {
+                        distance = rep3;
+                        rep3 = rep2;
+                    }
+                    rep2 = rep1;
+                }
+                rep1 = rep0;
+                rep0 = distance;
+            }
+            length = decode_length(range, &decoder->rep_length, pos_state);
+            state = state < 7 ? 8 : 11;
+        }
+        else
+        {
+            rep3 = rep2;
+            rep2 = rep1;
+            rep1 = rep0;
+            length = decode_length(range, &decoder->length, pos_state);
+            state = state < 7 ? 7 : 10;
+            rep0 = decode_distance(decoder, length);
+            if (rep0 == 0xFFFFFFFF)
+            {
+                /* End marker */
+                if (range->code)
+                    range->corrupt = 1;
+                break;
+            }
+            if ((known && !left) || rep0 >= decoder->dictionary || !distance_valid(&window, (uint64_t) rep0 + 1))
+            {
+                range->corrupt = 1;
+                break;
+            }
+        }
+
+        length += LZMA_MATCH_MIN;
+        if (known && left < length)
+        {
+            range->corrupt = 1;
+            break;
+        }
+        left -= length;
+        while (length-- && !window.stopped)
+            put_byte(&window, get_byte(&window, (size_t) rep0 + 1));
+    }
+
+    if (range->corrupt || (known && left && !window.stopped))
+        result = DECOMPRESS_ERR_CORRUPT;
+    else if (!window.stopped)
+        flush_window(&window);
+    if (!result && window.stopped)
+        result = DECOMPRESS_ERR_STOPPED;
+    close_window(&window);
+    free(decoder->literals);
+    free(decoder);
+    return result;
+}
+
+uint64_t decompressed_size(uint8_t method, const uint8_t* data, size_t size)
+{
+    if (!data)
+        return DECOMPRESS_UNKNOWN_SIZE;
+    if ((method == DECOMPRESS_EFI || method == DECOMPRESS_TIANO) && size >= EFI_HEADER_SIZE)
+        return read_dword(data + 4);
+    if (method == DECOMPRESS_LZMA && size >= LZMA_HEADER_SIZE)
+        return (uint64_t) read_dword(data + 9) << 32 | read_dword(data + 5);
+    return DECOMPRESS_UNKNOWN_SIZE;
+}
+
+uint8_t decompress(uint8_t method, const uint8_t* data, size_t size, decompress_sink sink, void* context)
+{
+    if (!data)
+        return DECOMPRESS_ERR_CORRUPT;
+    if (method == DECOMPRESS_EFI)
+        return decompress_efi(data, size, EFI_PBIT_EFI, sink, context);
+    if (method == DECOMPRESS_TIANO)
+        return decompress_efi(data, size, EFI_PBIT_TIANO, sink, context);
+    if (method == DECOMPRESS_LZMA)
+        return decompress_lzma(data, size, sink, context);
+    return DECOMPRESS_ERR_CORRUPT;
+}
@@ -0,0 +1,34 @@
+#ifndef DECOMPRESS_H
+#define DECOMPRESS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Return codes, same values as ERR_* codes of the tools where they overlap */
+#define DECOMPRESS_SUCCESS           0
+#define DECOMPRESS_ERR_OUT_OF_MEMORY 5
+#define DECOMPRESS_ERR_CORRUPT       7 /* Stream is damaged or uses another algorithm */
+#define DECOMPRESS_ERR_STOPPED       8 /* Sink asked to stop */
+
+/* Compression methods of firmware sections */
+#define DECOMPRESS_EFI   1 /* EFI 1.1 compression, 8 KB window */
+#define DECOMPRESS_TIANO 2 /* Tiano compression, same format with wider positions */
+#define DECOMPRESS_LZMA  3 /* LZMA with 13-byte header of LZMA SDK */
+
+/* Size reported when stream header doesn't tell it */
+#define DECOMPRESS_UNKNOWN_SIZE ((uint64_t) -1)
+
+/* Receives consecutive blocks of decompressed data, nonzero return stops decompression.
+*  Block is valid only during the call */
+typedef int (*decompress_sink)(void* context, const uint8_t* block, size_t size);
+
+/* Decompressed size from stream header, DECOMPRESS_UNKNOWN_SIZE if it is not stored
+*  or the header is damaged */
+uint64_t decompressed_size(uint8_t method, const uint8_t* data, size_t size);
+
+/* Decompresses stream of size bytes and passes the output to sink in blocks.
+*  Memory is bounded by the sliding window of the method: up to 1 MB for EFI and
+*  Tiano streams and the dictionary size, but no more than the output, for LZMA */
+uint8_t decompress(uint8_t method, const uint8_t* data, size_t size, decompress_sink sink, void* context);
+
+#endif
@@ -0,0 +1,1356 @@
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "drivers.h"
+#include "extract.h"
+#include "firmware.h"
+#include "microcode.h"
+#include "optionrom.h"
+#include "pe.h"
+#include "search.h"
+#include "stats.h"
+#include "trace.h"
+#include "threads.h"
+
+/* String BIT, PE header of x86 image, for files that don't start with it */
+static const uint8_t bitx86_pattern[] = {
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x50, 0x45, 0x00, 0x00, 0x4C, 0x01
+};
+
+/* Intel GOP Driver */
+/* Search pattern: "Intel (R) GOP Driver" as Unicode string */
+static const uint8_t snb_pattern[] = {
+	0x49, 0x00, 0x6E, 0x00, 0x74, 0x00, 0x65, 0x00, 0x6C, 0x00, 0x28, 0x00,
+	0x52, 0x00, 0x29, 0x00, 0x20, 0x00, 0x53, 0x00
+};
+static const uint8_t ivb_pattern[] = {
+	0x49, 0x00, 0x6E, 0x00, 0x74, 0x00, 0x65, 0x00, 0x6C, 0x00, 0x28, 0x00,
+	0x52, 0x00, 0x29, 0x00, 0x20, 0x00, 0x49, 0x00
+};
+
+static const uint8_t gop_pattern[] = {
+	0x49, 0x00, 0x6E, 0x00, 0x74, 0x00, 0x65, 0x00, 0x6C, 0x00, 0x28, 0x00,
+	0x52, 0x00, 0x29, 0x00, 0x20, 0x00, 0x47, 0x00, 0x4F, 0x00, 0x50, 0x00,
+	0x20, 0x00, 0x44, 0x00, 0x72, 0x00, 0x69, 0x00, 0x76, 0x00, 0x65, 0x00,
+	0x72, 0x00
+};
+
+static const uint8_t crv_pattern[] = {
+	0x43, 0x00, 0x6C, 0x00, 0x6F, 0x00, 0x76, 0x00, 0x65, 0x00, 0x72, 0x00,
+	0x20, 0x00, 0x56, 0x00, 0x69, 0x00, 0x65, 0x00, 0x77, 0x00
+};
+
+/* Offset and length of parts of version string */
+#define GOP_VERSION_2_OFFSET 0x98
+#define GOP_VERSION_3_OFFSET 0xA0
+#define GOP_VERSION_HSW_OFFSET 0xC0
+#define GOP_VERSION_BRW_OFFSET 0xF4
+#define GOP_VERSION_VLV_OFFSET 0x88
+#define GOP_VERSION_CHV_OFFSET 0x88
+#define GOP_VERSION_SKL_OFFSET 0xAC
+#define GOP_MAJOR_LENGTH 4
+#define GOP_MINOR_LENGTH 4
+#define GOP_REVISION_LENGTH 8
+#define GOP_BUILD_LENGTH 10
+
+/* ASPEED GOP Driver */
+/* Search pattern hwx string */
+static const uint8_t gop_ast_pattern[] = {
+	0x0F, 0x10, 0x0B, 0x0D, 0x10, 0x0B, 0x0C, 0x10, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00
+};
+static const uint8_t goprom_ast_pattern[] = {
+	0x00, 0x50, 0x43, 0x49, 0x52
+};
+
+/* Offset and length of parts of version string */
+#define GOP_AST_VERSION_OFFSET 57
+#define GOP_AST_VERSION_LENGTH 0x3
+
+/* AMD GOP Driver */
+static const uint8_t amdgop_pattern[] = {
+	0x41, 0x00, 0x4D, 0x00, 0x44, 0x00, 0x20, 0x00, 0x47, 0x00, 0x4F, 0x00,
+	0x50, 0x00
+};
+
+static const uint8_t ms_cert_pattern[] = {
+	0x4D, 0x69, 0x63, 0x72, 0x6F, 0x73, 0x6F, 0x66, 0x74, 0x20, 0x52, 0x6F,
+	0x6F, 0x74, 0x20, 0x43, 0x65, 0x72, 0x74, 0x69, 0x66, 0x69, 0x63, 0x61,
+	0x74, 0x65, 0x20, 0x41,	0x75, 0x74, 0x68, 0x6F, 0x72, 0x69, 0x74, 0x79
+};
+
+#define AMDGOP1_VERSION_OFFSET 0x2E
+#define AMDGOP2_VERSION_OFFSET 0x3E
+#define AMDGOP_VERSION_LENGTH 0x18
+#define AMDGOP_15_VERSION_LENGTH 0x14
+
+/* Intel RST Driver */
+/* Search pattern: "Intel (R) RST 1" as Unicode string */
+static const uint8_t rst_pattern[] = {
+	0x49, 0x00, 0x6E, 0x00, 0x74, 0x00, 0x65, 0x00, 0x6C, 0x00, 0x28, 0x00,
+	0x52, 0x00, 0x29, 0x00, 0x20, 0x00, 0x52, 0x00, 0x53, 0x00, 0x54, 0x00,
+	0x20, 0x00, 0x31, 0x00
+};
+
+/* Offset and length of parts of version string */
+#define RST_VERSION_OFFSET 0x1A
+#define RST_VERSION_LENGTH 0x16
+
+/* Intel RSTe Driver */
+/* Search pattern: "Intel (R) RSTe " as Unicode string */
+static const uint8_t rste_pattern[] = {
+	0x49, 0x00, 0x6E, 0x00, 0x74, 0x00, 0x65, 0x00, 0x6C, 0x00, 0x20, 0x00,
+	0x52, 0x00, 0x53, 0x00, 0x54, 0x00, 0x65, 0x00, 0x20, 0x00
+};
+
+/* Intel RSTe sSATA Driver */
+static const uint8_t 	ssata_pattern[] = {
+	0x00, 0x00, 0x49, 0x00, 0x6E, 0x00 ,0x74, 0x00, 0x65, 0x00, 0x6C, 0x00,
+	0x20, 0x00, 0x52, 0x00, 0x53, 0x00, 0x54, 0x00, 0x65, 0x00, 0x20, 0x00,
+	0x73, 0x00, 0x53, 0x00, 0x41, 0x00, 0x54, 0x00, 0x41, 0x00, 0x20, 0x00,
+	0x43, 0x00, 0x6F, 0x00, 0x6E, 0x00, 0x74, 0x00, 0x72, 0x00, 0x6F, 0x00,
+	0x6C, 0x00, 0x6C, 0x00, 0x65, 0x00, 0x72, 0x00
+};
+
+/* Intel RSTe SCU Driver */
+static const uint8_t scu_pattern[] = {
+	0x00, 0x53, 0x00, 0x43, 0x00, 0x55, 0x00
+};
+
+#define RSTE_VERSION_OFFSET 0x16
+#define RSTE_VERSION_LENGTH 0x16
+
+
+/* Intel RST NVMe Driver */
+static const uint8_t nvme_pattern[] = {
+	0x4E, 0x00, 0x56, 0x00, 0x4D, 0x00, 0x65, 0x00, 0x20, 0x00, 0x55, 0x00,
+	0x45, 0x00, 0x46, 0x00, 0x49, 0x00, 0x20, 0x00, 0x44, 0x00, 0x72, 0x00,
+	0x69, 0x00, 0x76, 0x00, 0x65, 0x00, 0x72, 0x00
+};
+
+#define NVME_VERSION_OFFSET 0x16
+#define NVME_VERSION_LENGTH 0x14
+
+
+/* AMD RAID Driver */
+/* Search pattern: "AMD Raid Channel" as Unicode string */
+static const uint8_t amdu_pattern[] = {
+	0x52, 0x00, 0x41, 0x00, 0x49, 0x00, 0x44, 0x00, 0x20, 0x00, 0x55, 0x00,
+	0x74, 0x00, 0x69, 0x00, 0x6C, 0x00, 0x69, 0x00, 0x74, 0x00, 0x79, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x5B, 0x00, 0x52, 0x00,
+	0x65, 0x00, 0x76
+};
+
+#define AMDR_VERSION_OFFSET 0x28
+#define AMDR_VERSION_LENGTH 0x10
+
+/* AMD Utility Driver */
+/* Search pattern: "AMD Utility [Rev" as Unicode string */
+static const uint8_t amdr_pattern[] = {
+	0x41, 0x00, 0x4D, 0x00, 0x44, 0x00, 0x20, 0x00, 0x52, 0x00, 0x61, 0x00,
+	0x69, 0x00, 0x64, 0x00, 0x20, 0x00, 0x43, 0x00, 0x68, 0x00, 0x61, 0x00,
+	0x6E, 0x00, 0x6E, 0x00, 0x65, 0x00, 0x6C, 0x00
+};
+
+#define AMDU_VERSION_OFFSET 0x2C
+#define AMDU_VERSION_LENGTH 0x10
+
+/* Intel LAN Driver */
+/* Search pattern HEX String*/
+static const uint8_t lani_pattern[] = {
+	0x69, 0x08, 0x00, 0x20, 0x0C, 0x9A, 0x66
+};
+static const uint8_t lanGB_pattern[] = {
+	0x49, 0x00, 0x6E, 0x00, 0x74, 0x00, 0x65, 0x00, 0x6C, 0x00, 0x28, 0x00,
+	0x52, 0x00, 0x29, 0x00, 0x20, 0x00, 0x47, 0x00, 0x69, 0x00, 0x67, 0x00,
+	0x61, 0x00, 0x62, 0x00, 0x69, 0x00, 0x74, 0x00, 0x20, 0x00, 0x25, 0x00,
+	0x31, 0x00, 0x64, 0x00
+};
+static const uint8_t lan40_pattern[] = {
+	0x49, 0x00, 0x6E, 0x00, 0x74, 0x00, 0x65, 0x00, 0x6C, 0x00, 0x28, 0x00,
+	0x52, 0x00, 0x29, 0x00, 0x20, 0x00, 0x34, 0x00, 0x30, 0x00, 0x47, 0x00,
+	0x62, 0x00, 0x45, 0x00
+};
+static const uint8_t lan10_pattern[] = {
+	0x49, 0x00, 0x6E, 0x00, 0x74, 0x00, 0x65, 0x00, 0x6C, 0x00, 0x28, 0x00,
+	0x52, 0x00, 0x29, 0x00, 0x20, 0x00, 0x31, 0x00, 0x30, 0x00, 0x47, 0x00,
+	0x62, 0x00, 0x45, 0x00, 0x20, 0x00, 0x44, 0x00, 0x72, 0x00, 0x69, 0x00,
+	0x76, 0x00, 0x65, 0x00, 0x72, 0x00
+};
+static const uint8_t lans_pattern[] = {
+	0x49, 0x00, 0x6E, 0x00, 0x74, 0x00, 0x65, 0x00, 0x6C, 0x00, 0x28, 0x00,
+	0x52, 0x00, 0x29, 0x00, 0x20, 0x00, 0x50, 0x00, 0x52, 0x00, 0x4F, 0x00,
+	0x2F, 0x00, 0x31, 0x00, 0x30, 0x00, 0x30, 0x00, 0x30, 0x00, 0x20, 0x00,
+	0x47
+};
+
+static const uint8_t fcoe_pattern[] = {
+	0x49, 0x00, 0x6E, 0x00, 0x74, 0x00, 0x65, 0x00, 0x6C, 0x00, 0x28, 0x00,
+	0x52, 0x00, 0x29, 0x00, 0x20, 0x00, 0x46, 0x00, 0x43, 0x00, 0x6F, 0x00,
+	0x45, 0x00, 0x20, 0x00, 0x42, 0x00, 0x6F, 0x00, 0x6F, 0x00, 0x74, 0x00,
+	0x20, 0x00, 0x4E, 0x00, 0x61, 0x00, 0x74, 0x00, 0x69, 0x00, 0x76, 0x00,
+	0x65, 0x00, 0x20, 0x00, 0x55, 0x00, 0x45, 0x00, 0x46, 0x00, 0x49, 0x00,
+	0x20, 0x00, 0x44, 0x00, 0x72, 0x00, 0x69, 0x00, 0x76, 0x00, 0x65, 0x00,
+	0x72, 0x00, 0x20, 0x00, 0x76, 0x00
+};
+
+static const uint8_t fcoeh_pattern[] = {
+	0xAC, 0xB6, 0xB4, 0xB6, 0x76, 0xB1, 0x5E, 0x80
+};
+
+#define LANI_VERSION_4_OFFSET 0x32
+#define LANI_VERSION_5_OFFSET 0x22
+#define LANI_VERSION_LENGTH 0x3
+#define FCOE_VERSION_OFFSET 0x4E
+#define FCOE_VERSION_LENGTH 0x12
+
+/* Marwell SATA Driver */
+/* Search pattern is "Marwell Connection" as Unicode string */
+static const uint8_t msata_pattern[] = {
+	0x4D, 0x00, 0x61, 0x00, 0x72, 0x00, 0x76, 0x00, 0x65, 0x00, 0x6C, 0x00, 
+	0x6C, 0x00, 0x20, 0x00, 0x43, 0x00, 0x68, 0x00, 0x61, 0x00, 0x6E, 0x00, 
+	0x6E, 0x00, 0x65, 0x00, 0x6C, 0x00
+};
+/* Marwell RAID Driver */
+/* Search pattern is "Marwell Connection" as Unicode string */
+static const uint8_t msatar_pattern[] = {
+	0x20, 0x00, 0x52, 0x00, 0x41, 0x00, 0x49, 0x00, 0x44, 0x00, 0x20
+};
+
+#define MSATA_VERSION_OFFSET 56
+#define MSATA_VERSION_LENGTH 0x4
+
+/* Realtek LAN Driver */
+/* Search pattern HEX String*/
+static const uint8_t lanrtk_pattern[] = {
+	0x52, 0x00, 0x65, 0x00, 0x61, 0x00, 0x6C, 0x00,
+	0x74, 0x00, 0x65, 0x00, 0x6B, 0x00, 0x20, 0x00,
+	0x55, 0x00, 0x45, 0x00, 0x46, 0x00, 0x49, 0x00,
+	0x20, 0x00, 0x55, 0x00, 0x4E, 0x00, 0x44, 0x00,
+	0x49, 0x00, 0x20, 0x00, 0x44, 0x00, 0x72, 0x00,
+	0x69, 0x00, 0x76, 0x00, 0x65, 0x00, 0x72, 0x00
+};
+static const uint8_t lanr_new_pattern[] = {
+	0x01, 0xB2, 0x38, 0x78, 0x81, 0x43, 0x9B, 0x43
+};
+static const uint8_t lanr_old_pattern[] = {
+	0x04, 0x34, 0x00, 0x00, 0x00, 0x34, 0x00, 0x00, 0x00
+};
+
+/* Broadcom LAN Driver */
+/* Search pattern HEX String*/
+static const uint8_t lanb_pattern[] = {
+	0x55, 0x4E, 0x44, 0x49, 0x5F, 0x56, 0x45, 0x52
+};
+
+#define LANB_VERSION_14_OFFSET 0x11A
+#define LANB_VERSION_15_OFFSET 0x12A
+#define LANB_VERSION_16_OFFSET 0x16A
+#define LANB_VERSION_16_1_OFFSET 0x1CA
+#define LANB_VERSION_LENGTH 0x3
+
+/* Intel CPU Microcode, updates are found by their header, names of known CPUIDs */
+typedef struct
+{
+    uint32_t    cpuid;
+    const char* name;
+} cpu_codename;
+
+static const cpu_codename cpu_codenames[] = {
+    { 0x040671, "BDW" },   /* LGA1150 */
+    { 0x0306C3, "HSW" },
+    { 0x0306A9, "IVB" },   /* LGA1155 */
+    { 0x0206A7, "SNB" },
+    { 0x0306E7, "IVB-E" }, /* LGA2011 */
+    { 0x0306E4, "IVB-E" },
+    { 0x0206D7, "SNB-E" },
+    { 0x0206D6, "SNB-E" },
+    { 0x0306F2, "HSW-E" }, /* LGA2011v3 */
+    { 0x0506E3, "SKL-S" }  /* LGA1151 */
+};
+
+/* Signature table. Signatures that tell which driver the file holds are asked
+*  for every file and found together in one pass, signatures that only refine
+*  one driver are looked up the first time its branch asks for them.
+*  In PE and TE images signatures are searched only in raw data of sections,
+*  unless they belong to headers or to data appended to the image */
+#define SIG_LAZY 0
+#define SIG_PASS 1
+
+#define SCOPE_IMAGE 0
+#define SCOPE_FILE  1
+
+typedef struct
+{
+    const char*    name;
+    const uint8_t* pattern;
+    size_t         length;
+    uint8_t        lookup;   /* SIG_PASS or SIG_LAZY */
+    uint8_t        scope;    /* SCOPE_IMAGE or SCOPE_FILE */
+} driver_signature;
+
+#define SIGNATURE(name, lookup, scope) { #name, name##_pattern, sizeof(name##_pattern), lookup, scope }
+
+#define SIG_BITX86       0
+#define SIG_SNB          1
+#define SIG_IVB          2
+#define SIG_GOP          3
+#define SIG_CRV          4
+#define SIG_GOP_AST      5
+#define SIG_GOPROM_AST   6
+#define SIG_AMDGOP       7
+#define SIG_MS_CERT      8
+#define SIG_RST          9
+#define SIG_RSTE         10
+#define SIG_SSATA        11
+#define SIG_SCU          12
+#define SIG_NVME         13
+#define SIG_AMDU         14
+#define SIG_AMDR         15
+#define SIG_LANI         16
+#define SIG_LANGB        17
+#define SIG_LAN40        18
+#define SIG_LAN10        19
+#define SIG_LANS         20
+#define SIG_FCOE         21
+#define SIG_FCOEH        22
+#define SIG_MSATA        23
+#define SIG_MSATAR       24
+#define SIG_LANRTK       25
+#define SIG_LANR_NEW     26
+#define SIG_LANR_OLD     27
+#define SIG_LANB         28
+#define SIG_COUNT        29
+
+static const driver_signature signatures[SIG_COUNT] = {
+    SIGNATURE(bitx86, SIG_LAZY, SCOPE_FILE),
+    SIGNATURE(snb, SIG_LAZY, SCOPE_IMAGE),
+    SIGNATURE(ivb, SIG_LAZY, SCOPE_IMAGE),
+    SIGNATURE(gop, SIG_PASS, SCOPE_IMAGE),
+    SIGNATURE(crv, SIG_LAZY, SCOPE_IMAGE),
+    SIGNATURE(gop_ast, SIG_PASS, SCOPE_IMAGE),
+    SIGNATURE(goprom_ast, SIG_LAZY, SCOPE_FILE),
+    SIGNATURE(amdgop, SIG_PASS, SCOPE_IMAGE),
+    SIGNATURE(ms_cert, SIG_LAZY, SCOPE_FILE),
+    SIGNATURE(rst, SIG_PASS, SCOPE_IMAGE),
+    SIGNATURE(rste, SIG_PASS, SCOPE_IMAGE),
+    SIGNATURE(ssata, SIG_LAZY, SCOPE_IMAGE),
+    SIGNATURE(scu, SIG_LAZY, SCOPE_IMAGE),
+    SIGNATURE(nvme, SIG_PASS, SCOPE_IMAGE),
+    SIGNATURE(amdu, SIG_PASS, SCOPE_IMAGE),
+    SIGNATURE(amdr, SIG_PASS, SCOPE_IMAGE),
+    SIGNATURE(lani, SIG_PASS, SCOPE_IMAGE),
+    SIGNATURE(lanGB, SIG_LAZY, SCOPE_IMAGE),
+    SIGNATURE(lan40, SIG_LAZY, SCOPE_IMAGE),
+    SIGNATURE(lan10, SIG_LAZY, SCOPE_IMAGE),
+    SIGNATURE(lans, SIG_LAZY, SCOPE_IMAGE),
+    SIGNATURE(fcoe, SIG_PASS, SCOPE_IMAGE),
+    SIGNATURE(fcoeh, SIG_LAZY, SCOPE_IMAGE),
+    SIGNATURE(msata, SIG_PASS, SCOPE_IMAGE),
+    SIGNATURE(msatar, SIG_LAZY, SCOPE_IMAGE),
+    SIGNATURE(lanrtk, SIG_PASS, SCOPE_IMAGE),
+    SIGNATURE(lanr_new, SIG_LAZY, SCOPE_IMAGE),
+    SIGNATURE(lanr_old, SIG_LAZY, SCOPE_IMAGE),
+    SIGNATURE(lanb, SIG_PASS, SCOPE_IMAGE)
+};
+
+#undef SIGNATURE
+
+/* Signatures of the pass are found through one 4-byte anchor each, its window
+*  with most distinct bytes, the last one of equal windows, so runs of padding
+*  and common UTF-16 prefixes like "Intel(R) " are skipped. Anchor hashes are
+*  kept in a bitmap checked at every position of the file, and candidates that
+*  pass it are compared with the whole signature */
+#define ANCHOR_BITS 16
+
+struct driver_database
+{
+    size_t   anchor[SIG_COUNT];  /* Offset of anchor in every signature of the pass */
+    uint32_t hash[SIG_COUNT];    /* Anchor hash of every signature of the pass */
+    uint8_t  filter[(1 << ANCHOR_BITS) / 8];
+    compiled_pattern* compiled[SIG_COUNT]; /* Lazy signatures */
+};
+
+/* Facts about signatures of one file, memoized when they are first asked for.
+*  The pass records first and last match, lazy lookups stop at the first one */
+typedef struct
+{
+    const driver_database* database;
+    const uint8_t* begin;            /* Sections of the image, whole file if it isn't one */
+    const uint8_t* end;
+    const uint8_t* file_begin;
+    const uint8_t* file_end;
+    uint16_t machine;                /* Machine type from the header, 0 if it isn't an image */
+    uint8_t scanned;                 /* Pass is done */
+    uint8_t known[SIG_COUNT];        /* Lazy signature is looked up */
+    const uint8_t* first[SIG_COUNT];
+    const uint8_t* last[SIG_COUNT];
+} signature_facts;
+
+static uint32_t anchor_hash(const uint8_t* data)
+{
+    uint32_t gram;
+
+    memcpy(&gram, data, sizeof(gram));
+    return (gram * 0x9E3779B1u) >> (32 - ANCHOR_BITS);
+}
+
+driver_database* open_driver_database(void)
+{
+    driver_database* database;
+    const uint8_t* window;
+    size_t i, offset;
+    int distinct, best;
+
+    database = (driver_database*) calloc(1, sizeof(driver_database));
+    if (!database)
+        return NULL;
+
+    for (i = 0; i < SIG_COUNT; i++)
+    {
+        if (signatures[i].lookup == SIG_LAZY)
+        {
+            database->compiled[i] = compile_pattern(signatures[i].pattern, NULL, signatures[i].length);
+            if (!database->compiled[i])
+            {
+                close_driver_database(database);
+                return NULL;
+            }
+            continue;
+        }
+
+        best = 0;
+        for (offset = 0; offset + 4 <= signatures[i].length; offset++)
+        {
+            window = signatures[i].pattern + offset;
+            distinct = 1 + (window[1] != window[0]) +
+                       (window[2] != window[0] && window[2] != window[1]) +
+                       (window[3] != window[0] && window[3] != window[1] && window[3] != window[2]);
+            if (distinct >= best)
+            {
+                best = distinct;
+                database->anchor[i] = offset;
+            }
+        }
+        database->hash[i] = anchor_hash(signatures[i].pattern + database->anchor[i]);
+        database->filter[database->hash[i] >> 3] |= (uint8_t) (1 << (database->hash[i] & 7));
+    }
+    return database;
+}
+
+void close_driver_database(driver_database* database)
+{
+    size_t i;
+
+    if (!database)
+        return;
+    for (i = 0; i < SIG_COUNT; i++)
+        free_compiled_pattern(database->compiled[i]);
+    free(database);
+}
+
+size_t driver_stats_entries(void)
+{
+    return SIG_COUNT + 1;
+}
+
+const char* driver_stats_name(size_t entry)
+{
+    if (entry < SIG_COUNT)
+        return signatures[entry].name;
+    return entry == SIG_COUNT ? "(one-pass scan)" : NULL;
+}
+
+/* Records first and last match of every signature of the pass, all of them are image scoped */
+static void scan_signatures(signature_facts* facts)
+{
+    const driver_database* database = facts->database;
+    const uint8_t* begin = facts->begin;
+    const uint8_t* end = facts->end;
+    const uint8_t* position;
+    const uint8_t* start;
+    stats_mark mark;
+    trace_span span;
+    uint32_t hash;
+    size_t i;
+
+    facts->scanned = 1;
+    if (!begin || end - begin < 4)
+        return;
+    stats_begin(&mark);
+    trace_begin(&span);
+
+    for (position = begin; position + 4 <= end; position++)
+    {
+        hash = anchor_hash(position);
+        if (!(database->filter[hash >> 3] & (1 << (hash & 7))))
+            continue;
+
+        for (i = 0; i < SIG_COUNT; i++)
+        {
+            if (signatures[i].lookup != SIG_PASS || database->hash[i] != hash ||
+                (size_t) (position - begin) < database->anchor[i])
+                continue;
+            start = position - database->anchor[i];
+            if ((size_t) (end - start) < signatures[i].length ||
+                memcmp(start, signatures[i].pattern, signatures[i].length))
+            {
+                if (mark.thread)
+                {
+                    mark.thread->candidates++;
+                    stats_add(i, 0, 0, 1, 0);
+                }
+                continue;
+            }
+
+            if (mark.thread)
+            {
+                mark.thread->candidates++;
+                mark.thread->matches++;
+                stats_add(i, 0, 0, 1, 1);
+            }
+            if (!facts->first[i])
+                facts->first[i] = start;
+            facts->last[i] = start;
+        }
+    }
+
+    /* The pass is a search of its own, it is counted like the engines count theirs */
+    if (mark.thread)
+    {
+        mark.thread->calls++;
+        mark.thread->bytes += (uint64_t) (end - begin);
+        stats_end(&mark, SIG_COUNT);
+    }
+    trace_end(&span, "signature", "one-pass scan");
+}
+
+/* First match of signature, NULL if it is not in the file */
+static const uint8_t* first_hit(signature_facts* facts, size_t signature)
+{
+    stats_mark mark;
+    trace_span span;
+
+    if (signatures[signature].lookup == SIG_PASS)
+    {
+        if (!facts->scanned)
+            scan_signatures(facts);
+    }
+    else if (!facts->known[signature])
+    {
+        facts->known[signature] = 1;
+        stats_begin(&mark);
+        trace_begin(&span);
+        if (signatures[signature].scope == SCOPE_FILE)
+        {
+            if (facts->file_end > facts->file_begin)
+                facts->first[signature] = search_compiled(facts->database->compiled[signature],
+                                                          facts->file_begin, facts->file_end);
+        }
+        else if (facts->end > facts->begin)
+            facts->first[signature] = search_compiled(facts->database->compiled[signature], facts->begin, facts->end);
+        stats_end(&mark, signature);
+        trace_end(&span, "signature", "%s", signatures[signature].name);
+    }
+    return facts->first[signature];
+}
+
+/* Suffix of drivers that are told apart by their PE machine type */
+static const char* x86_suffix(signature_facts* facts)
+{
+    if (facts->machine)
+        return facts->machine == PE_MACHINE_I386 ? " x86" : "";
+    return first_hit(facts, SIG_BITX86) ? " x86" : "";
+}
+
+/* Prints one microcode update, revision as wide as it needs to be */
+static int print_microcode(void* context, const microcode_update* update)
+{
+    FILE* out = (FILE*) context;
+    const char* name = "";
+    size_t i;
+
+    for (i = 0; i < sizeof(cpu_codenames) / sizeof(cpu_codenames[0]); i++)
+    {
+        if (cpu_codenames[i].cpuid == update->cpuid)
+        {
+            name = cpu_codenames[i].name;
+            break;
+        }
+    }
+
+    fprintf(out, "     CPU Microcode %06X %-5s - %02X, platforms %02X, %04X-%02X-%02X, %lu bytes%s\n",
+            update->cpuid, name, update->revision, update->platforms,
+            update->date & 0xFFFF, update->date >> 24, (update->date >> 16) & 0xFF,
+            (unsigned long) update->size, update->checksum_valid ? "" : ", bad checksum");
+    return 0;
+}
+
+/* Longest version string printed, UTF-16 strings of unknown length are cut there */
+#define VERSION_STRING_SIZE 64
+#define GOP_BUILD_LENGTH_MAX (2 * VERSION_STRING_SIZE)
+
+/* Identifies one module, in_rom is set for images of a walked option ROM */
+static uint8_t identify_module(const driver_database* database, const uint8_t* buffer, size_t size, uint8_t in_rom,
+                               FILE* out)
+{
+    signature_facts facts;
+    pe_image image;
+    const uint8_t* end;
+    const uint8_t* limit;
+    const uint8_t* found;
+	const uint8_t* check;
+	char build[VERSION_STRING_SIZE];
+	uint8_t ast[3];
+	char mnr;
+
+    end = buffer + size - 1;
+    limit = buffer + size;
+
+    /* Nothing is searched until the first decision asks for it */
+    memset(&facts, 0, sizeof(facts));
+    facts.database = database;
+    facts.file_begin = buffer;
+    facts.file_end = end;
+    facts.begin = buffer;
+    facts.end = end;
+
+    /* Headers and appended certificates of PE and TE images are left out */
+    if (parse_pe(buffer, size, &image) == PE_SUCCESS)
+    {
+        facts.machine = image.machine;
+        if (image.begin)
+        {
+            facts.begin = image.begin;
+            facts.end = image.end < end ? image.end : end;
+        }
+    }
+
+    /* Searching for GOP pattern in file */
+    found = first_hit(&facts, SIG_GOP);
+    if (found)
+	{
+		/* Checking for version 2 */
+		if (first_hit(&facts, SIG_SNB))
+		{
+		check = found + GOP_VERSION_2_OFFSET;
+		if ((check[0] == '2') || (check[0] == 'C'))
+		{
+			check += GOP_MAJOR_LENGTH;
+			check += GOP_MINOR_LENGTH;
+			if ((check[2] == 0x2E) || (check[2] == 0x00) || (check[10] != 0x00))
+				check += GOP_REVISION_LENGTH;
+			if (check[0] == 'L') 
+				check -= 0x20;
+			decode_utf16(build, sizeof(build), check, GOP_BUILD_LENGTH_MAX, limit);
+			/* Printing the version found */
+			fprintf(out, "     EFI GOP Driver SandyBridge - 2.0.%s\n", build);
+
+			return DRIVER_FOUND; 
+		}
+		}
+	
+		/* Checking for version 3 */
+		if (first_hit(&facts, SIG_IVB))
+		{
+		check = found + GOP_VERSION_3_OFFSET;
+		if ((check[0] == '3') || (check[0] == 'L'))
+		{
+			check += GOP_MAJOR_LENGTH;
+			check += GOP_MINOR_LENGTH;
+			if ((check[2] == 0x2E) || (check[2] == 0x00) || (check[10] != 0x00))
+				check += GOP_REVISION_LENGTH;
+			if (check[0] == 0x45)
+				check -= 0x30;
+			decode_utf16(build, sizeof(build), check, GOP_BUILD_LENGTH_MAX, limit);
+			/* Printing the version found */
+			fprintf(out, "     EFI GOP Driver IvyBridge   - 3.0.%s\n", build);
+
+			return DRIVER_FOUND; 
+		}
+		}
+
+		/* Checking for version 5 Haswell*/
+		check = found + GOP_VERSION_HSW_OFFSET;
+		if ((check[0] == '5') || (check[0] == 'H') || ((check[0] == 0x06) && (check[1] == 0x0A)))
+			{
+			check += GOP_MAJOR_LENGTH; 
+			check += GOP_MINOR_LENGTH; 
+			if (check[-2] == 'I')
+	 			check -= 0x48;
+			else if ((check[0] == 0x1A) && (check[1] == 0x0A) && (check[40] == '5'))
+	 			check = check + 56;
+			decode_utf16(build, sizeof(build), check, GOP_BUILD_LENGTH_MAX, limit);
+
+			/* Printing the version found */
+			fprintf(out, "     EFI GOP Driver Haswell     - 5.0.%s\n", build);
+
+		return DRIVER_FOUND;
+
+		}
+
+		/* Checking for version 5.5 Broadwell*/
+		check = found + GOP_VERSION_BRW_OFFSET;
+		if (check[0] == '5')
+		{
+			check += GOP_MAJOR_LENGTH;
+			decode_utf16(build, sizeof(build), check, GOP_BUILD_LENGTH_MAX, limit);
+
+			/* Printing the version found */
+			fprintf(out, "     EFI GOP Driver Broadwell   - 5.5.%s\n", build);
+
+			return DRIVER_FOUND; 
+		}
+
+		/* Checking for version 6 CloverView*/
+		if (first_hit(&facts, SIG_CRV))
+		{
+		check = found;
+		if ((check[-28] == '6') && (check[-26] == '.') && (check[-24] == '0'))
+			check -= 0x28;
+		if ((check[-40] == '6') && (check[-38] == '.') && (check[-36] == '0'))
+			check += 0x80;
+
+		decode_utf16(build, sizeof(build), check, GOP_BUILD_LENGTH_MAX, limit);
+
+		/* Printing the version found */
+		fprintf(out, "     EFI GOP Driver CloverView  - 6.0.%s%s\n", build, x86_suffix(&facts));
+
+			return DRIVER_FOUND; 
+		}
+
+		/* Checking for version ValleyView*/
+		check = found + GOP_VERSION_VLV_OFFSET;
+		if (check[0] == '7')
+		{
+		if ((check[4] == '0') && (check[8] == '1'))
+		{	mnr = '0';
+			check = check + 8;}
+		else if (((check[4] == '1') && (check[8] == '1')) ||
+			((check[4] == 0x00) && (check[8] == '1') && (check[20] == 0xFF)))
+		{	mnr = '1';
+			check = check + 8;}
+		else if ((check[4] == '1') && (check[16] == 0xFF))
+		{	mnr = '1';
+			check = check + 4;}
+		else if (((check[4] == '2') && (check[8] == '1')) ||
+			((check[4] == 0x00) && (check[8] == '1') && (check[20] == 0x00)))
+		{	mnr = '2';
+			check = check + 8;}
+		else if ((check[4] == '1') && (check[16] == 0x00))
+		{	mnr = '2';
+			check = check + 4;}
+
+                 	decode_utf16(build, sizeof(build), check, GOP_BUILD_LENGTH_MAX, limit);
+			fprintf(out, "     EFI GOP Driver ValleyView  - 7.%c.%s%s\n", mnr, build, x86_suffix(&facts));
+			return DRIVER_FOUND; 
+		}
+
+		/* Checking for version 8 CherryView*/
+		check = found + GOP_VERSION_CHV_OFFSET;
+		if (check[0] == '8')
+		{
+		if (check[4] != '1')
+		{
+			check += 0x4;
+		}
+			check += GOP_MAJOR_LENGTH;
+			decode_utf16(build, sizeof(build), check, GOP_BUILD_LENGTH_MAX, limit);
+
+			/* Printing the version found */
+			fprintf(out, "     EFI GOP Driver CherryView  - 8.0.%s\n", build);
+
+			return DRIVER_FOUND; 
+		}
+
+		/* Checking for version 9 SkyLake*/
+		check = found + GOP_VERSION_SKL_OFFSET;
+		{
+		if (((check[0] == '9') && (check[4] == '1')) ||
+		   ((check[-4] == '9') && (check[4] == '1')))
+			check += 4;
+		else if ((check[8] == '9') && (check[12] == '1'))
+			check += 12;
+		else if ((check[52] == '9') && (check[56] == '0') && (check[60] == '1'))
+			check += 60;
+
+			decode_utf16(build, sizeof(build), check, GOP_BUILD_LENGTH_MAX, limit);
+
+			/* Printing the version found */
+			fprintf(out, "     EFI GOP Driver SkyLake     - 9.0.%s\n", build);
+
+			return DRIVER_FOUND; 
+		}
+
+		/* Unknown version */
+		fprintf(out, "     Unknown version GOP Driver\n");
+		return DRIVER_UNKNOWN_VERSION;
+	}
+
+	/* Searching for AMD GOP pattern in file */
+	found = first_hit(&facts, SIG_AMDGOP);
+	if (found)
+	{
+		check = found;
+       		if ((check[46] == '1') && (check[66] == '.'))
+		{
+			found += AMDGOP1_VERSION_OFFSET;
+			decode_utf16(build, sizeof(build), found, AMDGOP_15_VERSION_LENGTH, limit);
+		}
+		else if ((check[46] == '1') && (check[66] != '.'))
+		{
+			found += AMDGOP1_VERSION_OFFSET;
+			decode_utf16(build, sizeof(build), found, AMDGOP_VERSION_LENGTH, limit);
+		}
+                else if ((check[46] == 'v') && (check[82] == '.'))
+		{
+			found += AMDGOP2_VERSION_OFFSET;
+			decode_utf16(build, sizeof(build), found, AMDGOP_15_VERSION_LENGTH, limit);
+		}
+                else
+		{
+			found += AMDGOP2_VERSION_OFFSET;
+			decode_utf16(build, sizeof(build), found, AMDGOP_VERSION_LENGTH, limit);
+		}
+
+		/* Printing the version found */
+		if (first_hit(&facts, SIG_MS_CERT))
+			fprintf(out, "     EFI AMD GOP Driver         - %s_signed\n", build);
+		else
+			fprintf(out, "     EFI AMD GOP Driver         - %s\n", build);
+
+		return DRIVER_FOUND; 
+	}
+
+	/* Searching for ASPEED GOP pattern in file */
+	found = first_hit(&facts, SIG_GOP_AST);
+	if (found)
+	{
+		check = found + GOP_AST_VERSION_OFFSET;
+		ast[0] = check[-1]; ast[1] = check[0]; ast[2] = check[1];
+		if ((found[GOP_AST_VERSION_OFFSET] == 37))
+			{ast[0] = 0x08; ast[1] = 0x93; ast[2] = 0x00;}
+		else if ((found[GOP_AST_VERSION_OFFSET] == 33))
+			{ast[0] = 0x00; ast[1] = 0x96; ast[2] = 0x00;}
+		else if ((found[GOP_AST_VERSION_OFFSET] == 144))
+			{ast[0] = 0x06; ast[1] = 0x97; ast[2] = 0x00;}
+
+        /* Printing the version found */
+	if (in_rom || first_hit(&facts, SIG_GOPROM_AST))
+		fprintf(out, "     EFI GOP-in-OROM ASPEED     - %x.%02x.%02x\n", ast[2], ast[1], ast[0]);
+	else
+		fprintf(out, "     EFI GOP ASPEED             - %x.%02x.%02x\n", ast[2], ast[1], ast[0]);
+
+        return DRIVER_FOUND;
+    }
+
+	/* Searching for RST pattern in file */
+	found = first_hit(&facts, SIG_RST);
+	if (found)
+	{
+		found += RST_VERSION_OFFSET;
+		decode_utf16(build, sizeof(build), found, RST_VERSION_LENGTH, limit);
+		/* Printing the version found */
+		fprintf(out, "     EFI IRST RAID for SATA     - %s\n", build);
+
+		return DRIVER_FOUND; 
+	}
+
+	/* Searching for NVMe pattern in file */
+	found = first_hit(&facts, SIG_NVME);
+	if (found)
+	{
+		found -= NVME_VERSION_OFFSET;
+		decode_utf16(build, sizeof(build), found, NVME_VERSION_LENGTH, limit);
+		/* Printing the version found */
+		fprintf(out, "     EFI IRST NVMe Driver       - %s\n", build);
+
+		return DRIVER_FOUND; 
+	}
+
+	/* Searching for AMD RAID pattern in file */
+	found = first_hit(&facts, SIG_AMDR);
+	if (found)
+	{
+		found += AMDR_VERSION_OFFSET;
+		decode_utf16(build, sizeof(build), found, AMDR_VERSION_LENGTH, limit);
+		/* Printing the version found */
+		fprintf(out, "     EFI AMD RAID               - %s\n", build);
+
+		return DRIVER_FOUND; 
+	}
+
+	/* Searching for AMD Utilty pattern in file */
+	found = first_hit(&facts, SIG_AMDU);
+	if (found)
+	{
+		check = found;
+	        found += AMDU_VERSION_OFFSET;
+		decode_utf16(build, sizeof(build), found, AMDU_VERSION_LENGTH, limit);
+		/* Printing the version found */
+		if (check[52] != ']')
+		fprintf(out, "     EFI AMD Utility            - %s\n", build);
+		else
+		fprintf(out, "     EFI AMD Utility            - %c.0.0.%c%c\n", check[44], check[48], check[50]);
+		return DRIVER_FOUND; 
+	}
+
+	/* Searching for RSTe pattern in file */
+	found = first_hit(&facts, SIG_RSTE);
+	if (found)
+	{
+		found += RSTE_VERSION_OFFSET;
+		decode_utf16(build, sizeof(build), found, RSTE_VERSION_LENGTH, limit);
+
+		/* Printing the version found */
+		if (first_hit(&facts, SIG_SCU))
+			fprintf(out, "     EFI IRSTe RAID for SCU     - %s\n", build);
+		else 
+			if (first_hit(&facts, SIG_SSATA))
+				fprintf(out, "     EFI IRSTe RAID for sSATA   - %s\n", build);
+			else
+				fprintf(out, "     EFI IRSTe RAID for SATA    - %s\n", build);
+		return DRIVER_FOUND; 
+	}
+
+    /* Searching for MSATA pattern in file */
+    found = first_hit(&facts, SIG_MSATA);
+    if (found)
+    {
+        check = found + MSATA_VERSION_OFFSET;
+
+        /* Printing the version found */
+		found = first_hit(&facts, SIG_MSATAR);
+		if (found)
+		fprintf(out, "     EFI Marvell SATA RAID      - %x.%x.%x.%04x\n", (check[3] >> 4), (check[3] & 0x0F), check[2], *(const uint16_t*)check);
+		else
+		fprintf(out, "     EFI Marvell SATA AHCI      - %x.%x.%x.%04x\n", (check[3] >> 4), (check[3] & 0x0F), check[2], *(const uint16_t*)check);
+
+        return DRIVER_FOUND;
+    }
+
+	/* Searching for LANI pattern in file */
+    found = first_hit(&facts, SIG_LANI);
+    if (found)
+    {
+		/* Checking for version 4 */
+       if (found[LANI_VERSION_4_OFFSET] == 4)
+            check = found + LANI_VERSION_4_OFFSET;
+		/* Checking for version 5 or 6 */
+        else if (found[LANI_VERSION_5_OFFSET] == 3 || found[LANI_VERSION_5_OFFSET] == 4 ||
+		 found[LANI_VERSION_5_OFFSET] == 5 || found[LANI_VERSION_5_OFFSET] == 6 ||
+		 ((found[LANI_VERSION_5_OFFSET-3]  == 0) && (found[LANI_VERSION_5_OFFSET-2]  == 1) &&
+		 (found[LANI_VERSION_5_OFFSET-1]  == 0) && (found[LANI_VERSION_5_OFFSET]  == 0) &&
+		 (found[LANI_VERSION_5_OFFSET+1]  == 0) && (found[LANI_VERSION_5_OFFSET+30]  == 0x2F)) || 
+		found[LANI_VERSION_5_OFFSET]  != 0)
+                check = found + LANI_VERSION_5_OFFSET;
+	else if (first_hit(&facts, SIG_LANGB))
+		{
+		if (found[LANI_VERSION_5_OFFSET] == 0)
+		check = found + LANI_VERSION_5_OFFSET;
+		}
+        else if (first_hit(&facts, SIG_LAN40))
+		{
+		if (found[LANI_VERSION_5_OFFSET] == 0)
+            	check = found - 30;
+		}
+        else {
+            fprintf(out, "     Unknown Intel LAN version.\n");
+            return DRIVER_NOT_FOUND;
+        }
+
+        /* Printing the version found */
+
+		if (first_hit(&facts, SIG_LAN40))
+			fprintf(out, "     EFI Intel 40GbE UNDI       - %x.%x.%02x\n", check[0], check[-1], check[-2]);
+		else if (first_hit(&facts, SIG_LAN10))
+			fprintf(out, "     EFI Intel 10GbE UNDI       - %x.%x.%02x\n", check[0], check[-1], check[-2]);
+		else if (first_hit(&facts, SIG_LANS))
+			fprintf(out, "     EFI Intel PRO/Server UNDI  - %x.%x.%02x\n", check[0], check[-1], check[-2]);
+		else if (first_hit(&facts, SIG_LANGB))
+			fprintf(out, "     EFI Intel Gigabit UNDI     - %x.%x.%02x\n", check[0], check[-1], check[-2]);
+		else
+			fprintf(out, "     EFI Intel PRO/1000 UNDI    - %x.%x.%02x\n", check[0], check[-1], check[-2]);
+
+		return DRIVER_FOUND; 
+    }
+
+	/* Searching for FCoE pattern in file */
+	found = first_hit(&facts, SIG_FCOE);
+	if (found)
+	{
+		found += FCOE_VERSION_OFFSET;
+		check = (found);
+		if (check[0] == '1')
+		{
+			decode_utf16(build, sizeof(build), found, FCOE_VERSION_LENGTH, limit);
+		/* Printing the version found */
+			fprintf(out, "     EFI Intel FCoE Boot        - %s\n", build);
+			return DRIVER_FOUND; 
+		}
+		else if (first_hit(&facts, SIG_FCOEH))
+		{
+			check = (first_hit(&facts, SIG_FCOEH)) + 35;
+			if (check[0] == 1)
+			{
+				fprintf(out, "     EFI Intel FCoE Boot        - %d.%d.%02d\n", check[0], check[-1],check[-2]);
+				return DRIVER_FOUND;}
+		}
+		fprintf(out, "     Unknown Intel FCoE version.\n");
+		return DRIVER_NOT_FOUND;
+	}
+
+	/* Searching for LANB pattern in file */
+   found = first_hit(&facts, SIG_LANB);
+   if (found)
+   {
+		/* Checking for version 14 */
+        if (found[LANB_VERSION_14_OFFSET] == 14)
+            check = found + LANB_VERSION_14_OFFSET;
+		/* Checking for version 15 */
+        else if (found[LANB_VERSION_15_OFFSET] == 15)
+            check = found + LANB_VERSION_15_OFFSET;
+		/* Checking for version 16 */
+        else if (found[LANB_VERSION_16_OFFSET] == 16)
+            check = found + LANB_VERSION_16_OFFSET;
+        else if (found[LANB_VERSION_16_1_OFFSET] == 16)
+            check = found + LANB_VERSION_16_1_OFFSET;
+        else {
+            fprintf(out, "     Unknown Broadcom LAN version.\n");
+            return DRIVER_NOT_FOUND;
+        }
+        /* Printing the version found */
+	fprintf(out, "     EFI Broadcom UNDI          - %d.%d.%d\n", check[0], check[-1], check[-2]);
+	return DRIVER_FOUND; 
+   }
+
+	/* Searching for LAN Realtek pattern in new file */
+   found = first_hit(&facts, SIG_LANRTK);
+   if (found)
+   {
+	if (first_hit(&facts, SIG_LANR_NEW))
+	{
+	check = first_hit(&facts, SIG_LANR_NEW);
+		if (check[-22] == 0x20)
+			check = check - 22;
+		else if ((check[-23] == 0x20) || (check[-23] == 0x30))
+			check = check - 23;
+		else if (check[-11] == 0x20)
+			check = check - 11;
+	 	else {
+		fprintf(out, "     Unknown Realtek LAN version.\n");
+		return DRIVER_NOT_FOUND;}
+	}
+
+	else if (first_hit(&facts, SIG_LANR_OLD))
+	{
+	check = first_hit(&facts, SIG_LANR_OLD);
+		if ((check[-30] == 0x20) || (check[-30] != 0x2F)  || 
+		    (check[-29] != 0x00) || (check[-31] == 0x00))
+			check = check - 30;
+		else if (check[-18] == 0x20)
+			check = check - 18;
+	 	else {
+			fprintf(out, "     Unknown Realtek LAN version.\n");
+		return DRIVER_NOT_FOUND;}
+	}
+	else {
+		fprintf(out, "     Unknown Realtek LAN version.\n");
+		return DRIVER_NOT_FOUND;}
+
+	/* Printing the version found */
+	if (check[-2] != 0) {
+		fprintf(out, "     EFI Realtek UNDI           - %x.%03X %X%s\n", check[0] >> 4, check[-1], check[-2], x86_suffix(&facts));
+        	return DRIVER_FOUND;}
+	else {
+		fprintf(out, "     EFI Realtek UNDI           - %x.%03X%s\n", check[0] >> 4, check[-1], x86_suffix(&facts));
+        	return DRIVER_FOUND;}
+
+
+
+   }
+
+	/* Listing every CPU microcode update */
+   if (find_microcode(buffer, limit, print_microcode, out))
+       	return DRIVER_FOUND;
+
+  return DRIVER_NOT_FOUND;
+}
+
+/* Option ROM walk state, images are identified one by one */
+typedef struct
+{
+    const driver_database* database;
+    FILE* out;
+    unsigned long index;
+    uint8_t found;
+    uint8_t unknown;
+} rom_walk;
+
+static const char* rom_code_type_name(uint8_t code_type)
+{
+    switch (code_type)
+    {
+    case ROM_CODE_LEGACY:        return "Legacy";
+    case ROM_CODE_OPEN_FIRMWARE: return "Open Firmware";
+    case ROM_CODE_HP_PA_RISC:    return "HP PA RISC";
+    case ROM_CODE_EFI:           return "EFI";
+    default:                     return "Unknown";
+    }
+}
+
+static const char* rom_machine_name(uint16_t machine)
+{
+    switch (machine)
+    {
+    case PE_MACHINE_I386: return " IA32";
+    case PE_MACHINE_X64:  return " x64";
+    case PE_MACHINE_EBC:  return " EBC";
+    default:              return "";
+    }
+}
+
+/* Prints image of option ROM and identifies driver in its own bytes */
+static int identify_rom_image(void* context, const option_rom_image* image)
+{
+    rom_walk* walk = (rom_walk*) context;
+    const uint8_t* begin;
+    uint8_t result;
+
+    fprintf(walk->out, "     PCI ROM image %-13lu- %04X:%04X %s%s%s\n", walk->index++, image->vendor, image->device,
+            rom_code_type_name(image->code_type), rom_machine_name(image->machine),
+            image->compressed ? ", compressed" : "");
+
+    /* Compressed EFI images can't be scanned */
+    if (image->compressed)
+        return 0;
+    begin = image->efi ? image->efi : image->begin;
+    result = identify_module(walk->database, begin, (size_t) (image->end - begin), 1, walk->out);
+    if (result == DRIVER_FOUND)
+        walk->found = 1;
+    else if (result == DRIVER_UNKNOWN_VERSION)
+        walk->unknown = 1;
+    return 0;
+}
+
+uint8_t identify_driver(const driver_database* database, const uint8_t* buffer, size_t size, FILE* out)
+{
+    rom_walk walk;
+
+    /* Every image of option ROM is identified, others are single modules */
+    memset(&walk, 0, sizeof(walk));
+    walk.database = database;
+    walk.out = out;
+    if (!walk_option_rom(buffer, size, identify_rom_image, &walk))
+        return identify_module(database, buffer, size, 0, out);
+
+    if (walk.found)
+        return DRIVER_FOUND;
+    return walk.unknown ? DRIVER_UNKNOWN_VERSION : DRIVER_NOT_FOUND;
+}
+
+/* Identification of one module of firmware image */
+typedef struct
+{
+    char*   text;       /* Captured output, NULL if it wasn't captured */
+    uint8_t result;
+    uint8_t duplicate;  /* Same GUID and contents as a module before it */
+} module_report;
+
+/* Work shared by threads identifying modules */
+typedef struct
+{
+    const driver_database* database;
+    const firmware_index*  index;
+    module_report* reports;
+} firmware_job;
+
+#ifdef _WIN32
+/* Returns contents of stream as zero-terminated string, NULL on failure */
+static char* read_stream(FILE* stream)
+{
+    char* text;
+    long length;
+
+    if (fseek(stream, 0, SEEK_END) || (length = ftell(stream)) < 0 || fseek(stream, 0, SEEK_SET))
+        return NULL;
+    text = (char*) malloc((size_t) length + 1);
+    if (!text)
+        return NULL;
+    if (fread(text, 1, (size_t) length, stream) != (size_t) length)
+    {
+        free(text);
+        return NULL;
+    }
+    text[length] = 0;
+    return text;
+}
+#endif
+
+uint8_t open_driver_capture(driver_capture* capture)
+{
+    capture->text = NULL;
+    capture->size = 0;
+#ifdef _WIN32
+    /* There is no memory stream on Windows, temporary files are kept in memory
+    *  by the file cache as long as they are small */
+    capture->stream = tmpfile();
+#else
+    capture->stream = open_memstream(&capture->text, &capture->size);
+#endif
+    return capture->stream ? DRIVER_FOUND : DRIVER_ERR_OUT_OF_MEMORY;
+}
+
+char* close_driver_capture(driver_capture* capture)
+{
+    char* text;
+    int failed;
+
+    failed = fflush(capture->stream) || ferror(capture->stream);
+#ifdef _WIN32
+    text = failed ? NULL : read_stream(capture->stream);
+    fclose(capture->stream);
+#else
+    if (fclose(capture->stream))
+        failed = 1;
+    text = capture->text;
+    if (failed)
+    {
+        free(text);
+        text = NULL;
+    }
+#endif
+    capture->stream = NULL;
+    capture->text = NULL;
+    return text;
+}
+
+/* Identifies module into memory, so reports can be printed in image order */
+static void identify_firmware_module(void* context, size_t index)
+{
+    firmware_job* job = (firmware_job*) context;
+    const firmware_module* module = &job->index->modules[index];
+    module_report* report = &job->reports[index];
+    driver_capture capture;
+    char guid[GUID_STRING_SIZE];
+    trace_span span;
+
+    if (!module->body || report->duplicate || report->text)
+        return;
+    if (open_driver_capture(&capture))
+        return;
+    trace_begin(&span);
+    report->result = identify_driver(job->database, module->body, module->body_size, capture.stream);
+    report->text = close_driver_capture(&capture);
+    if (span.start)
+    {
+        format_guid(guid, module->guid);
+        trace_end(&span, "module", "Module %s%s%s", guid, module->name[0] ? " " : "", module->name);
+    }
+}
+
+/* Marks files repeated in image, like those of recovery volumes */
+static void mark_duplicates(const firmware_index* index, module_report* reports)
+{
+    const firmware_module* module;
+    const firmware_module* other;
+    size_t first, i, j;
+
+    for (first = 0; first < index->count; first = i)
+    {
+        for (i = first + 1; i < index->count && !memcmp(index->by_guid[i]->guid, index->by_guid[first]->guid, 16); i++)
+        {
+            module = index->by_guid[i];
+            for (j = first; j < i; j++)
+            {
+                other = index->by_guid[j];
+                if (module->file_size == other->file_size && !memcmp(module->file, other->file, module->file_size))
+                {
+                    reports[module - index->modules].duplicate = 1;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+uint8_t identify_firmware(const driver_database* database, const uint8_t* buffer, size_t size, unsigned threads,
+                          FILE* out)
+{
+    firmware_index index;
+    firmware_job job;
+    const firmware_module* module;
+    module_report* report;
+    char guid[GUID_STRING_SIZE];
+    unsigned long compressed = 0;
+    uint8_t found = 0, unknown = 0, failed = 0;
+    trace_span span;
+    size_t i;
+
+    trace_begin(&span);
+    if (build_firmware_index(buffer, size, &index))
+        return DRIVER_ERR_OUT_OF_MEMORY;
+    trace_end(&span, "firmware", "Index of %lu modules", (unsigned long) index.count);
+    if (!index.count)
+        return identify_driver(database, buffer, size, out);
+
+    job.database = database;
+    job.index = &index;
+    job.reports = (module_report*) calloc(index.count, sizeof(module_report));
+    if (!job.reports)
+    {
+        free_firmware_index(&index);
+        return DRIVER_ERR_OUT_OF_MEMORY;
+    }
+    mark_duplicates(&index, job.reports);
+
+    /* Modules that failed to start on threads are identified in the loop below */
+    run_parallel(index.count, threads, identify_firmware_module, &job);
+
+    for (i = 0; i < index.count; i++)
+    {
+        module = &index.modules[i];
+        report = &job.reports[i];
+        if (report->duplicate)
+            continue;
+        if (!module->body)
+        {
+            compressed += module->compressed;
+            continue;
+        }
+
+        /* Report that couldn't be captured on its thread is retried here,
+        *  one that can't be captured at all fails identification */
+        identify_firmware_module(&job, i);
+        if (!report->text)
+        {
+            failed = 1;
+            continue;
+        }
+        format_guid(guid, module->guid);
+        if (report->text[0])
+            fprintf(out, "     Module %s%s%s\n%s", guid, module->name[0] ? " " : "", module->name, report->text);
+
+        if (report->result == DRIVER_FOUND)
+            found = 1;
+        else if (report->result == DRIVER_UNKNOWN_VERSION)
+            unknown = 1;
+        free(report->text);
+    }
+    if (compressed)
+        fprintf(out, "     Compressed modules         - %lu not scanned\n", compressed);
+
+    free(job.reports);
+    free_firmware_index(&index);
+    if (failed)
+        return DRIVER_ERR_OUT_OF_MEMORY;
+    if (found)
+        return DRIVER_FOUND;
+    return unknown ? DRIVER_UNKNOWN_VERSION : DRIVER_NOT_FOUND;
+}
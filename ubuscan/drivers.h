@@ -0,0 +1,59 @@
+#ifndef DRIVERS_H
+#define DRIVERS_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Return codes, same values as ERR_* codes of drvver */
+#define DRIVER_FOUND             0
+#define DRIVER_NOT_FOUND         1
+#define DRIVER_ERR_OUT_OF_MEMORY 5
+#define DRIVER_UNKNOWN_VERSION   6
+
+/* Built-in signatures of all supported drivers, prepared to be found
+*  together in one pass. Database is never modified after it is opened,
+*  so one can be shared by any number of threads */
+typedef struct driver_database driver_database;
+
+/* Returns NULL if memory can't be allocated */
+driver_database* open_driver_database(void);
+void close_driver_database(driver_database* database);
+
+/* Statistics entries of signature lookups: entry of a signature is its number,
+*  the last one is the pass that finds all common signatures at once */
+size_t driver_stats_entries(void);
+const char* driver_stats_name(size_t entry);
+
+/* Output of identification collected in memory */
+typedef struct
+{
+    FILE*  stream;  /* Passed as out to identification */
+    char*  text;
+    size_t size;
+} driver_capture;
+
+/* Opens stream that collects what is written to it, DRIVER_ERR_OUT_OF_MEMORY if it can't be opened */
+uint8_t open_driver_capture(driver_capture* capture);
+
+/* Closes stream and returns the text written to it, zero-terminated and freed by the caller,
+*  NULL if some of it couldn't be kept */
+char* close_driver_capture(driver_capture* capture);
+
+/* Identifies EFI driver or CPU microcode in buffer of size bytes and prints
+*  its version line to out. File is scanned once for all signatures and never
+*  written, so a shared read-only image can be identified any number of times.
+*  Every image of PCI option ROM is listed and identified in its own bytes.
+*  Versions are read at fixed offsets around matches without bounds checks,
+*  so buffer must have IMAGE_GUARD_SIZE bytes of zeroes before and after it,
+*  as images of load_image and decompressed firmware sections have */
+uint8_t identify_driver(const driver_database* database, const uint8_t* buffer, size_t size, FILE* out);
+
+/* Identifies every module of firmware volumes in buffer on up to threads workers
+*  and prints reports of modules found in image order, each under its GUID and name.
+*  Buffers without firmware volumes are identified as a single driver.
+*  Buffer needs the same zeroed guards as for identify_driver */
+uint8_t identify_firmware(const driver_database* database, const uint8_t* buffer, size_t size, unsigned threads,
+                          FILE* out);
+
+#endif
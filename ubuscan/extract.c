@@ -0,0 +1,130 @@
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define EXTRACT_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "extract.h"
+
+void print_location(FILE* out, const char* prefix, const uint8_t* buffer, const uint8_t* found, const uint8_t* end,
+                    long offset, uint8_t end_marker, unsigned long max_length)
+{
+    const uint8_t* string = found + offset;
+    const uint8_t* terminate;
+    size_t length = 0;
+
+    if (offset >= end - found || offset < buffer - found)
+        string = NULL;
+    if (string)
+    {
+        length = (size_t) (end - string) > max_length ? (size_t) max_length : (size_t) (end - string);
+        terminate = (const uint8_t*) memchr(string, end_marker, length);
+        if (terminate)
+            length = terminate - string;
+
+        /* Strings stop at zero byte, as if printed with %s */
+        terminate = (const uint8_t*) memchr(string, 0, length);
+        if (terminate)
+            length = terminate - string;
+    }
+
+    fputs(prefix, out);
+    fwrite(string, 1, length, out);
+    fputc('\n', out);
+}
+
+/* UTF-8 sequence of code point, returns its length */
+static size_t encode_utf8(char* out, uint32_t point)
+{
+    if (point < 0x80)
+    {
+        out[0] = (char) point;
+        return 1;
+    }
+    if (point < 0x800)
+    {
+        out[0] = (char) (0xC0 | (point >> 6));
+        out[1] = (char) (0x80 | (point & 0x3F));
+        return 2;
+    }
+    if (point < 0x10000)
+    {
+        out[0] = (char) (0xE0 | (point >> 12));
+        out[1] = (char) (0x80 | ((point >> 6) & 0x3F));
+        out[2] = (char) (0x80 | (point & 0x3F));
+        return 3;
+    }
+    out[0] = (char) (0xF0 | (point >> 18));
+    out[1] = (char) (0x80 | ((point >> 12) & 0x3F));
+    out[2] = (char) (0x80 | ((point >> 6) & 0x3F));
+    out[3] = (char) (0x80 | (point & 0x3F));
+    return 4;
+}
+
+size_t decode_utf16(char* string, size_t size, const uint8_t* text, size_t max_length, const uint8_t* end)
+{
+    size_t length = 0, units, unit = 0, bytes;
+    uint32_t point, low;
+    char sequence[4];
+#ifdef EXTRACT_SSE2
+    __m128i block, ascii;
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i high = _mm_set1_epi16((short) 0xFF80);
+#endif
+
+    if (!size)
+        return 0;
+    if (text >= end)
+        max_length = 0;
+    else if ((size_t) (end - text) < max_length)
+        max_length = end - text;
+    units = max_length / 2;
+
+    while (unit < units)
+    {
+#ifdef EXTRACT_SSE2
+        /* Eight ASCII characters without zero are narrowed at once */
+        if (units - unit >= 8 && size - length > 8)
+        {
+            block = _mm_loadu_si128((const __m128i*) (text + 2 * unit));
+            ascii = _mm_andnot_si128(_mm_cmpeq_epi16(block, zero),
+                                     _mm_cmpeq_epi16(_mm_and_si128(block, high), zero));
+            if (_mm_movemask_epi8(ascii) == 0xFFFF)
+            {
+                _mm_storel_epi64((__m128i*) (string + length), _mm_packus_epi16(block, block));
+                length += 8;
+                unit += 8;
+                continue;
+            }
+        }
+#endif
+        point = (uint32_t) text[2 * unit] | ((uint32_t) text[2 * unit + 1] << 8);
+        if (!point)
+            break;
+        unit++;
+
+        /* Surrogate pairs make one character, unpaired halves are replaced */
+        if (point >= 0xD800 && point < 0xE000)
+        {
+            low = unit < units ? (uint32_t) text[2 * unit] | ((uint32_t) text[2 * unit + 1] << 8) : 0;
+            if (point < 0xDC00 && low >= 0xDC00 && low < 0xE000)
+            {
+                point = 0x10000 + ((point - 0xD800) << 10) + (low - 0xDC00);
+                unit++;
+            }
+            else
+                point = 0xFFFD;
+        }
+
+        /* Characters that don't fit whole are not started */
+        bytes = encode_utf8(sequence, point);
+        if (bytes >= size - length)
+            break;
+        memcpy(string + length, sequence, bytes);
+        length += bytes;
+    }
+    string[length] = 0;
+    return length;
+}
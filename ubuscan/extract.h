@@ -0,0 +1,20 @@
+#ifndef EXTRACT_H
+#define EXTRACT_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Prints prefix and string at offset from found to out, up to end_marker or max_length bytes
+*  Image is never written, terminator is searched only inside max_length window
+*  and strings outside the image are printed empty */
+void print_location(FILE* out, const char* prefix, const uint8_t* buffer, const uint8_t* found, const uint8_t* end,
+                    long offset, uint8_t end_marker, unsigned long max_length);
+
+/* Decodes UTF-16LE text in place into zero-terminated UTF-8 string of at most size bytes,
+*  reading no more than max_length bytes of text and nothing past end.
+*  Stops at zero character or before a character that doesn't fit whole,
+*  unpaired surrogates become U+FFFD. Returns length of string */
+size_t decode_utf16(char* string, size_t size, const uint8_t* text, size_t max_length, const uint8_t* end);
+
+#endif
@@ -0,0 +1,253 @@
+#if !defined(_WIN32) && !defined(_FILE_OFFSET_BITS)
+#define _FILE_OFFSET_BITS 64
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#define PATH_SEPARATOR '\\'
+#else
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#define PATH_SEPARATOR '/'
+#endif
+
+#include "filelist.h"
+
+static uint8_t add_file(file_list* list, const char* path, size_t length, uint64_t size)
+{
+    listed_file* files;
+    size_t capacity;
+    char* copy;
+
+    if (list->count == list->capacity)
+    {
+        capacity = list->capacity ? 2 * list->capacity : 256;
+        files = (listed_file*) realloc(list->files, capacity * sizeof(listed_file));
+        if (!files)
+            return FILELIST_ERR_OUT_OF_MEMORY;
+        list->files = files;
+        list->capacity = capacity;
+    }
+
+    copy = (char*) malloc(length + 1);
+    if (!copy)
+        return FILELIST_ERR_OUT_OF_MEMORY;
+    memcpy(copy, path, length);
+    copy[length] = 0;
+    list->files[list->count].path = copy;
+    list->files[list->count].size = size;
+    list->count++;
+    return FILELIST_SUCCESS;
+}
+
+/* Directory path with entry name appended, NULL if memory can't be allocated */
+static char* join_path(const char* directory, const char* name)
+{
+    size_t length = strlen(directory);
+    char* path;
+
+    path = (char*) malloc(length + strlen(name) + 2);
+    if (!path)
+        return NULL;
+    memcpy(path, directory, length);
+    if (length && directory[length - 1] != '/' && directory[length - 1] != PATH_SEPARATOR)
+        path[length++] = PATH_SEPARATOR;
+    strcpy(path + length, name);
+    return path;
+}
+
+#ifdef _WIN32
+uint8_t list_directory(const char* path, file_list* list)
+{
+    WIN32_FIND_DATAA entry;
+    HANDLE search;
+    char* pattern;
+    char* child;
+    uint8_t result = FILELIST_SUCCESS;
+
+    pattern = join_path(path, "*");
+    if (!pattern)
+        return FILELIST_ERR_OUT_OF_MEMORY;
+    search = FindFirstFileA(pattern, &entry);
+    free(pattern);
+    if (search == INVALID_HANDLE_VALUE)
+        return FILELIST_ERR_FILE_OPEN;
+
+    do
+    {
+        if (!strcmp(entry.cFileName, ".") || !strcmp(entry.cFileName, ".."))
+            continue;
+        child = join_path(path, entry.cFileName);
+        if (!child)
+        {
+            result = FILELIST_ERR_OUT_OF_MEMORY;
+            break;
+        }
+
+        /* Unreadable subdirectories are skipped, the rest of the tree is still listed */
+        if (entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+        {
+            if (!(entry.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT))
+                result = list_directory(child, list);
+            if (result == FILELIST_ERR_FILE_OPEN)
+                result = FILELIST_SUCCESS;
+        }
+        else
+            result = add_file(list, child, strlen(child),
+                              ((uint64_t) entry.nFileSizeHigh << 32) | entry.nFileSizeLow);
+        free(child);
+    } while (!result && FindNextFileA(search, &entry));
+
+    FindClose(search);
+    return result;
+}
+
+static uint64_t file_size(const char* path)
+{
+    struct _stati64 info;
+
+    if (_stati64(path, &info) || !(info.st_mode & _S_IFREG))
+        return 0;
+    return (uint64_t) info.st_size;
+}
+#else
+uint8_t list_directory(const char* path, file_list* list)
+{
+    DIR* directory;
+    struct dirent* entry;
+    struct stat info;
+    char* child;
+    uint8_t result = FILELIST_SUCCESS;
+
+    directory = opendir(path);
+    if (!directory)
+        return FILELIST_ERR_FILE_OPEN;
+
+    while (!result && (entry = readdir(directory)) != NULL)
+    {
+        if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
+            continue;
+        child = join_path(path, entry->d_name);
+        if (!child)
+        {
+            result = FILELIST_ERR_OUT_OF_MEMORY;
+            break;
+        }
+
+        /* Links to directories are not followed, so the walk can't loop */
+        if (!lstat(child, &info))
+        {
+            if (S_ISDIR(info.st_mode))
+            {
+                result = list_directory(child, list);
+                if (result == FILELIST_ERR_FILE_OPEN)
+                    result = FILELIST_SUCCESS;
+            }
+            else if (S_ISREG(info.st_mode) || (S_ISLNK(info.st_mode) && !stat(child, &info) && S_ISREG(info.st_mode)))
+                result = add_file(list, child, strlen(child), (uint64_t) info.st_size);
+        }
+        free(child);
+    }
+
+    closedir(directory);
+    return result;
+}
+
+static uint64_t file_size(const char* path)
+{
+    struct stat info;
+
+    if (stat(path, &info) || !S_ISREG(info.st_mode))
+        return 0;
+    return (uint64_t) info.st_size;
+}
+#endif
+
+uint8_t list_from_file(const char* filename, file_list* list)
+{
+    FILE* file;
+    char* text;
+    char* line;
+    char* next;
+    char* tail;
+    long length;
+    uint8_t result = FILELIST_SUCCESS;
+
+    file = fopen(filename, "rb");
+    if (!file)
+        return FILELIST_ERR_FILE_OPEN;
+    if (fseek(file, 0, SEEK_END) || (length = ftell(file)) < 0 || fseek(file, 0, SEEK_SET))
+    {
+        fclose(file);
+        return FILELIST_ERR_FILE_READ;
+    }
+
+    text = (char*) malloc((size_t) length + 1);
+    if (!text)
+    {
+        fclose(file);
+        return FILELIST_ERR_OUT_OF_MEMORY;
+    }
+    if (fread(text, 1, (size_t) length, file) != (size_t) length)
+    {
+        fclose(file);
+        free(text);
+        return FILELIST_ERR_FILE_READ;
+    }
+    fclose(file);
+    text[length] = 0;
+
+    for (line = text; line && !result; line = next)
+    {
+        next = strchr(line, '\n');
+        if (next)
+            *next++ = 0;
+
+        /* Trimming whitespace and CR of DOS line endings */
+        while (*line == ' ' || *line == '\t')
+            line++;
+        tail = line + strlen(line);
+        while (tail > line && isspace((unsigned char) tail[-1]))
+            *--tail = 0;
+
+        if (*line && *line != '#')
+            result = add_file(list, line, (size_t) (tail - line), file_size(line));
+    }
+
+    free(text);
+    return result;
+}
+
+static int compare_files(const void* first, const void* second)
+{
+    const listed_file* a = (const listed_file*) first;
+    const listed_file* b = (const listed_file*) second;
+
+    if (a->size != b->size)
+        return a->size > b->size ? -1 : 1;
+    return strcmp(a->path, b->path);
+}
+
+void sort_file_list(file_list* list)
+{
+    if (list->count)
+        qsort(list->files, list->count, sizeof(listed_file), compare_files);
+}
+
+void free_file_list(file_list* list)
+{
+    size_t i;
+
+    for (i = 0; i < list->count; i++)
+        free(list->files[i].path);
+    free(list->files);
+    memset(list, 0, sizeof(file_list));
+}
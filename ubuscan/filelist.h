@@ -0,0 +1,39 @@
+#ifndef FILELIST_H
+#define FILELIST_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Return codes, same values as ERR_* codes of the tools */
+#define FILELIST_SUCCESS           0
+#define FILELIST_ERR_FILE_OPEN     2
+#define FILELIST_ERR_FILE_READ     3
+#define FILELIST_ERR_OUT_OF_MEMORY 5
+
+/* File to process in a batch */
+typedef struct
+{
+    char*    path;
+    uint64_t size;  /* 0 if the file can't be found */
+} listed_file;
+
+typedef struct
+{
+    listed_file* files;
+    size_t count;
+    size_t capacity;
+} file_list;
+
+/* Adds regular files of directory and all its subdirectories to list */
+uint8_t list_directory(const char* path, file_list* list);
+
+/* Adds files named in list file, one path per line,
+*  empty lines and lines starting with # are skipped */
+uint8_t list_from_file(const char* filename, file_list* list);
+
+/* Orders files largest first, files of the same size by path */
+void sort_file_list(file_list* list);
+
+void free_file_list(file_list* list);
+
+#endif
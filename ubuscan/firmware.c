@@ -0,0 +1,511 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "decompress.h"
+#include "extract.h"
+#include "firmware.h"
+#include "image.h"
+
+/* Firmware volume header, all fields are little-endian */
+#define FV_GUID             0x10
+#define FV_LENGTH           0x20
+#define FV_SIGNATURE        0x28
+#define FV_ATTRIBUTES       0x2C
+#define FV_HEADER_LENGTH    0x30
+#define FV_EXT_HEADER       0x34
+#define FV_HEADER_MIN       0x48 /* Block map with one entry and terminator */
+#define FV_ERASE_POLARITY   0x00000800
+#define FV_EXT_HEADER_SIZE  0x10 /* Offset of extension size, after volume name */
+
+/* FFS file header */
+#define FFS_TYPE            0x12
+#define FFS_ATTRIBUTES      0x13
+#define FFS_SIZE            0x14
+#define FFS_STATE           0x17
+#define FFS_HEADER_SIZE     0x18
+#define FFS_LARGE_SIZE      0x18
+#define FFS_LARGE_HEADER    0x20
+#define FFS_ATTRIB_LARGE    0x01
+#define FFS_DATA_VALID      0x04
+#define FFS_DELETED         0x10
+
+/* Sections */
+#define SECTION_HEADER_SIZE     4
+#define SECTION_LARGE_HEADER    8
+#define SECTION_COMPRESSION     0x01
+#define SECTION_GUID_DEFINED    0x02
+#define SECTION_PE32            0x10
+#define SECTION_TE              0x12
+#define SECTION_USER_INTERFACE  0x15
+#define SECTION_FV_IMAGE        0x17
+#define SECTION_RAW             0x19
+#define COMPRESSION_HEADER      9    /* Uncompressed length and compression type follow */
+#define COMPRESSION_NONE        0
+#define COMPRESSION_STANDARD    1    /* EFI or Tiano */
+#define COMPRESSION_CUSTOMIZED  2    /* LZMA */
+#define GUIDED_DATA_OFFSET      0x14
+#define GUIDED_ATTRIBUTES       0x16
+#define GUIDED_HEADER           0x18
+#define GUIDED_PROCESSING       0x01
+
+/* Nested volumes and encapsulation sections deeper than this are skipped */
+#define FIRMWARE_MAX_DEPTH 8
+
+static const uint8_t ffs2_guid[16] = {
+    0x78, 0xE5, 0x8C, 0x8C, 0x3D, 0x8A, 0x1C, 0x4F, 0x99, 0x35, 0x89, 0x61, 0x85, 0xC3, 0x2D, 0xD3
+};
+static const uint8_t ffs3_guid[16] = {
+    0x7A, 0xC0, 0x73, 0x54, 0xCB, 0x3D, 0xCA, 0x4D, 0xBD, 0x6F, 0x1E, 0x96, 0x89, 0xE7, 0x34, 0x9A
+};
+
+/* GUID-defined sections that are decompressed, others needing processing are left alone */
+static const uint8_t lzma_guid[16] = {
+    0x98, 0x58, 0x4E, 0xEE, 0x14, 0x39, 0x59, 0x42, 0x9D, 0x6E, 0xDC, 0x7B, 0xD7, 0x94, 0x03, 0xCF
+};
+static const uint8_t tiano_guid[16] = {
+    0xAD, 0x80, 0x12, 0xA3, 0x1E, 0x48, 0xB6, 0x41, 0x95, 0xE8, 0x12, 0x7F, 0x4C, 0x98, 0x47, 0x79
+};
+
+/* Decompressed section being collected. Data has IMAGE_GUARD_SIZE bytes of
+*  zeroes on both sides like loaded images, identification reads past matches */
+typedef struct
+{
+    uint8_t* base;     /* Allocation, data starts IMAGE_GUARD_SIZE bytes later */
+    size_t   size;
+    size_t   capacity;
+    size_t   limit;
+} section_output;
+
+static uint16_t read_word(const uint8_t* data)
+{
+    return (uint16_t) (data[0] | (data[1] << 8));
+}
+
+static uint32_t read_dword(const uint8_t* data)
+{
+    return (uint32_t) data[0] | ((uint32_t) data[1] << 8) | ((uint32_t) data[2] << 16) | ((uint32_t) data[3] << 24);
+}
+
+static uint32_t read_size24(const uint8_t* data)
+{
+    return (uint32_t) data[0] | ((uint32_t) data[1] << 8) | ((uint32_t) data[2] << 16);
+}
+
+static uint64_t read_qword(const uint8_t* data)
+{
+    return (uint64_t) read_dword(data) | ((uint64_t) read_dword(data + 4) << 32);
+}
+
+static size_t align_up(size_t value, size_t alignment)
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+static uint8_t walk_volume(firmware_index* index, const uint8_t* volume, size_t size, unsigned depth);
+static uint8_t walk_sections(firmware_index* index, size_t module, const uint8_t* stream, size_t size, unsigned depth);
+
+/* Length of volume at data, 0 if its header is not valid */
+static size_t volume_length(const uint8_t* data, size_t size)
+{
+    uint64_t length;
+    uint16_t header, sum = 0;
+    size_t i;
+
+    if (size < FV_HEADER_MIN || memcmp(data + FV_SIGNATURE, "_FVH", 4))
+        return 0;
+    length = read_qword(data + FV_LENGTH);
+    header = read_word(data + FV_HEADER_LENGTH);
+    if (header < FV_HEADER_MIN || header & 1 || length < header || length > size)
+        return 0;
+
+    /* 16-bit words of header sum to zero */
+    for (i = 0; i < header; i += 2)
+        sum = (uint16_t) (sum + read_word(data + i));
+    return sum ? 0 : (size_t) length;
+}
+
+static uint8_t add_module(firmware_index* index, size_t* module)
+{
+    firmware_module* modules;
+    size_t capacity;
+
+    if (index->count == index->capacity)
+    {
+        capacity = index->capacity ? 2 * index->capacity : 64;
+        modules = (firmware_module*) realloc(index->modules, capacity * sizeof(firmware_module));
+        if (!modules)
+            return FIRMWARE_ERR_OUT_OF_MEMORY;
+        index->modules = modules;
+        index->capacity = capacity;
+    }
+
+    *module = index->count++;
+    memset(&index->modules[*module], 0, sizeof(firmware_module));
+    return FIRMWARE_SUCCESS;
+}
+
+static int append_output(void* context, const uint8_t* block, size_t size)
+{
+    section_output* output = (section_output*) context;
+    uint8_t* data;
+    size_t capacity;
+
+    if (size > output->limit - output->size)
+        return 1;
+    if (size > output->capacity - output->size)
+    {
+        capacity = output->capacity > size ? 2 * output->capacity : output->size + size;
+        if (capacity > output->limit)
+            capacity = output->limit;
+        data = (uint8_t*) realloc(output->base, IMAGE_GUARD_SIZE + capacity + IMAGE_GUARD_SIZE);
+        if (!data)
+            return 1;
+        if (!output->base)
+            memset(data, 0, IMAGE_GUARD_SIZE);
+        output->base = data;
+        output->capacity = capacity;
+    }
+    memcpy(output->base + IMAGE_GUARD_SIZE + output->size, block, size);
+    output->size += size;
+    return 0;
+}
+
+/* Decompresses section data and walks sections inside it. Data that is damaged,
+*  compressed some other way or doesn't fit the limit marks the module compressed */
+static uint8_t open_compressed(firmware_index* index, size_t module, uint8_t method,
+                               const uint8_t* data, size_t size, unsigned depth)
+{
+    section_output output;
+    firmware_buffer* buffers;
+    uint64_t declared;
+    uint8_t result;
+    size_t capacity;
+
+    if (depth > FIRMWARE_MAX_DEPTH)
+        return FIRMWARE_SUCCESS;
+
+    memset(&output, 0, sizeof(output));
+    output.limit = FIRMWARE_MAX_DECOMPRESSED - index->decompressed;
+    declared = decompressed_size(method, data, size);
+    if (declared != DECOMPRESS_UNKNOWN_SIZE && declared && declared <= output.limit)
+    {
+        output.base = (uint8_t*) malloc(IMAGE_GUARD_SIZE + (size_t) declared + IMAGE_GUARD_SIZE);
+        if (output.base)
+        {
+            memset(output.base, 0, IMAGE_GUARD_SIZE);
+            output.capacity = (size_t) declared;
+        }
+    }
+
+    /* Standard compression is EFI or Tiano, and the header doesn't tell which */
+    result = decompress(method, data, size, append_output, &output);
+    if (result == DECOMPRESS_ERR_CORRUPT && (method == DECOMPRESS_EFI || method == DECOMPRESS_TIANO))
+    {
+        output.size = 0;
+        result = decompress(method == DECOMPRESS_EFI ? DECOMPRESS_TIANO : DECOMPRESS_EFI, data, size,
+                            append_output, &output);
+    }
+    if (result || !output.size)
+    {
+        free(output.base);
+        if (result)
+            index->modules[module].compressed = 1;
+        return FIRMWARE_SUCCESS;
+    }
+
+    if (index->buffer_count == index->buffer_capacity)
+    {
+        capacity = index->buffer_capacity ? 2 * index->buffer_capacity : 16;
+        buffers = (firmware_buffer*) realloc(index->buffers, capacity * sizeof(firmware_buffer));
+        if (!buffers)
+        {
+            free(output.base);
+            return FIRMWARE_ERR_OUT_OF_MEMORY;
+        }
+        index->buffers = buffers;
+        index->buffer_capacity = capacity;
+    }
+    memset(output.base + IMAGE_GUARD_SIZE + output.size, 0, IMAGE_GUARD_SIZE);
+    index->buffers[index->buffer_count].data = output.base + IMAGE_GUARD_SIZE;
+    index->buffers[index->buffer_count].size = output.size;
+    index->buffer_count++;
+    index->decompressed += output.size;
+
+    return walk_sections(index, module, output.base + IMAGE_GUARD_SIZE, output.size, depth + 1);
+}
+
+/* Walks section stream of file, encapsulation sections are opened in place.
+*  Module is kept as a number, nested volumes may move the module array */
+static uint8_t walk_sections(firmware_index* index, size_t module, const uint8_t* stream, size_t size, unsigned depth)
+{
+    const uint8_t* section;
+    const uint8_t* data;
+    firmware_module* owner;
+    size_t offset = 0, length, header;
+    uint8_t type, result, processing;
+
+    if (depth > FIRMWARE_MAX_DEPTH)
+        return FIRMWARE_SUCCESS;
+
+    while (size - offset >= SECTION_HEADER_SIZE)
+    {
+        section = stream + offset;
+        length = read_size24(section);
+        type = section[3];
+        header = SECTION_HEADER_SIZE;
+        if (length == 0xFFFFFF)
+        {
+            if (size - offset < SECTION_LARGE_HEADER)
+                break;
+            length = read_dword(section + SECTION_HEADER_SIZE);
+            header = SECTION_LARGE_HEADER;
+        }
+        if (length < header || length > size - offset)
+            break;
+        data = section + header;
+        owner = &index->modules[module];
+
+        switch (type)
+        {
+        case SECTION_PE32:
+        case SECTION_TE:
+            if (!owner->body || owner->type == FFS_TYPE_FREEFORM)
+            {
+                owner->body = data;
+                owner->body_size = length - header;
+            }
+            break;
+        case SECTION_RAW:
+            if (!owner->body)
+            {
+                owner->body = data;
+                owner->body_size = length - header;
+            }
+            break;
+        case SECTION_USER_INTERFACE:
+            if (!owner->name[0])
+                decode_utf16(owner->name, sizeof(owner->name), data, length - header, section + length);
+            break;
+        case SECTION_COMPRESSION:
+            if (length - header < COMPRESSION_HEADER - SECTION_HEADER_SIZE)
+                break;
+            type = data[COMPRESSION_HEADER - SECTION_HEADER_SIZE - 1];
+            data += COMPRESSION_HEADER - SECTION_HEADER_SIZE;
+            header += COMPRESSION_HEADER - SECTION_HEADER_SIZE;
+            if (type == COMPRESSION_NONE)
+                result = walk_sections(index, module, data, length - header, depth + 1);
+            else if (type == COMPRESSION_STANDARD)
+                result = open_compressed(index, module, DECOMPRESS_EFI, data, length - header, depth);
+            else if (type == COMPRESSION_CUSTOMIZED)
+                result = open_compressed(index, module, DECOMPRESS_LZMA, data, length - header, depth);
+            else
+            {
+                owner->compressed = 1;
+                result = FIRMWARE_SUCCESS;
+            }
+            if (result)
+                return result;
+            break;
+        case SECTION_GUID_DEFINED:
+            /* Offsets are relative to the section, large headers shift the fields */
+            if (length < header + GUIDED_HEADER - SECTION_HEADER_SIZE)
+                break;
+            processing = read_word(data + GUIDED_ATTRIBUTES - SECTION_HEADER_SIZE) & GUIDED_PROCESSING;
+            header = read_word(data + GUIDED_DATA_OFFSET - SECTION_HEADER_SIZE);
+            if (header > length)
+                break;
+            if (!processing)
+                result = walk_sections(index, module, section + header, length - header, depth + 1);
+            else if (!memcmp(data, lzma_guid, 16))
+                result = open_compressed(index, module, DECOMPRESS_LZMA, section + header, length - header, depth);
+            else if (!memcmp(data, tiano_guid, 16))
+                result = open_compressed(index, module, DECOMPRESS_TIANO, section + header, length - header, depth);
+            else
+            {
+                owner->compressed = 1;
+                result = FIRMWARE_SUCCESS;
+            }
+            if (result)
+                return result;
+            break;
+        case SECTION_FV_IMAGE:
+            result = walk_volume(index, data, length - header, depth + 1);
+            if (result)
+                return result;
+            break;
+        }
+
+        offset = align_up(offset + length, 4);
+        if (offset > size)
+            break;
+    }
+    return FIRMWARE_SUCCESS;
+}
+
+/* Indexes files of volume, volumes of other file systems are skipped */
+static uint8_t walk_volume(firmware_index* index, const uint8_t* volume, size_t size, unsigned depth)
+{
+    const uint8_t* file;
+    size_t length, offset, header, module, extension;
+    uint8_t erased, state, result;
+    int large, empty;
+    size_t i;
+
+    if (depth > FIRMWARE_MAX_DEPTH)
+        return FIRMWARE_SUCCESS;
+    size = volume_length(volume, size);
+    if (!size)
+        return FIRMWARE_SUCCESS;
+    large = !memcmp(volume + FV_GUID, ffs3_guid, 16);
+    if (!large && memcmp(volume + FV_GUID, ffs2_guid, 16))
+        return FIRMWARE_SUCCESS;
+    index->volumes++;
+
+    erased = (read_dword(volume + FV_ATTRIBUTES) & FV_ERASE_POLARITY) ? 0xFF : 0x00;
+    offset = read_word(volume + FV_HEADER_LENGTH);
+    extension = read_word(volume + FV_EXT_HEADER);
+    if (extension && extension + FV_EXT_HEADER_SIZE + 4 <= size)
+        offset = extension + read_dword(volume + extension + FV_EXT_HEADER_SIZE);
+    offset = align_up(offset, 8);
+
+    while (offset < size && size - offset >= FFS_HEADER_SIZE)
+    {
+        file = volume + offset;
+
+        /* Free space ends the file list */
+        empty = 1;
+        for (i = 0; i < FFS_HEADER_SIZE && empty; i++)
+            empty = file[i] == erased;
+        if (empty)
+            break;
+
+        length = read_size24(file + FFS_SIZE);
+        header = FFS_HEADER_SIZE;
+        if (large && (file[FFS_ATTRIBUTES] & FFS_ATTRIB_LARGE))
+        {
+            if (size - offset < FFS_LARGE_HEADER)
+                break;
+            length = (size_t) read_qword(file + FFS_LARGE_SIZE);
+            header = FFS_LARGE_HEADER;
+        }
+        if (length < header || length > size - offset)
+            break;
+
+        /* State bits are inverted on flash erased to ones */
+        state = erased ? (uint8_t) ~file[FFS_STATE] : file[FFS_STATE];
+        if ((state & FFS_DATA_VALID) && !(state & FFS_DELETED) && file[FFS_TYPE] != FFS_TYPE_PAD)
+        {
+            result = add_module(index, &module);
+            if (result)
+                return result;
+            memcpy(index->modules[module].guid, file, 16);
+            index->modules[module].type = file[FFS_TYPE];
+            index->modules[module].file = file;
+            index->modules[module].file_size = length;
+
+            if (file[FFS_TYPE] == FFS_TYPE_RAW)
+            {
+                index->modules[module].body = file + header;
+                index->modules[module].body_size = length - header;
+            }
+            else
+            {
+                result = walk_sections(index, module, file + header, length - header, depth);
+                if (result)
+                    return result;
+            }
+        }
+
+        offset = align_up(offset + length, 8);
+    }
+    return FIRMWARE_SUCCESS;
+}
+
+static int compare_modules(const void* first, const void* second)
+{
+    const firmware_module* a = *(const firmware_module* const*) first;
+    const firmware_module* b = *(const firmware_module* const*) second;
+    int order;
+
+    order = memcmp(a->guid, b->guid, 16);
+    if (order)
+        return order;
+    return a < b ? -1 : a > b;
+}
+
+uint8_t build_firmware_index(const uint8_t* buffer, size_t size, firmware_index* index)
+{
+    size_t offset, length, i;
+    uint8_t result;
+
+    memset(index, 0, sizeof(firmware_index));
+    if (!buffer)
+        return FIRMWARE_SUCCESS;
+
+    /* Volumes are found by signature, files of valid ones are skipped over */
+    for (offset = 0; size - offset >= FV_HEADER_MIN; offset += 8)
+    {
+        if (buffer[offset + FV_SIGNATURE] != '_' || !(length = volume_length(buffer + offset, size - offset)))
+            continue;
+        result = walk_volume(index, buffer + offset, size - offset, 0);
+        if (result)
+        {
+            free_firmware_index(index);
+            return result;
+        }
+        offset += align_up(length, 8) - 8;
+        if (offset >= size)
+            break;
+    }
+
+    if (!index->count)
+        return FIRMWARE_SUCCESS;
+    index->by_guid = (const firmware_module**) malloc(index->count * sizeof(firmware_module*));
+    if (!index->by_guid)
+    {
+        free_firmware_index(index);
+        return FIRMWARE_ERR_OUT_OF_MEMORY;
+    }
+    for (i = 0; i < index->count; i++)
+        index->by_guid[i] = &index->modules[i];
+    qsort(index->by_guid, index->count, sizeof(firmware_module*), compare_modules);
+    return FIRMWARE_SUCCESS;
+}
+
+const firmware_module* find_firmware_module(const firmware_index* index, const uint8_t* guid)
+{
+    size_t low = 0, high = index->count, middle;
+
+    /* Lower bound, so the first module in image order is found */
+    while (low < high)
+    {
+        middle = low + (high - low) / 2;
+        if (memcmp(index->by_guid[middle]->guid, guid, 16) < 0)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    if (low < index->count && !memcmp(index->by_guid[low]->guid, guid, 16))
+        return index->by_guid[low];
+    return NULL;
+}
+
+void free_firmware_index(firmware_index* index)
+{
+    size_t i;
+
+    for (i = 0; i < index->buffer_count; i++)
+        free(index->buffers[i].data - IMAGE_GUARD_SIZE);
+    free(index->buffers);
+    free(index->modules);
+    free((void*) index->by_guid);
+    memset(index, 0, sizeof(firmware_index));
+}
+
+void format_guid(char* string, const uint8_t* guid)
+{
+    sprintf(string, "%08X-%04X-%04X-%02X%02X-%02X%02X%02X%02X%02X%02X",
+            (unsigned) read_dword(guid), read_word(guid + 4), read_word(guid + 6),
+            guid[8], guid[9], guid[10], guid[11], guid[12], guid[13], guid[14], guid[15]);
+}
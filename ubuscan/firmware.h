@@ -0,0 +1,73 @@
+#ifndef FIRMWARE_H
+#define FIRMWARE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Return codes, same values as ERR_* codes of the tools where they overlap */
+#define FIRMWARE_SUCCESS           0
+#define FIRMWARE_ERR_OUT_OF_MEMORY 5
+
+/* FFS file types */
+#define FFS_TYPE_RAW      0x01
+#define FFS_TYPE_FREEFORM 0x02
+#define FFS_TYPE_PAD      0xF0
+
+/* Longest module name kept, longer user interface names are cut */
+#define FIRMWARE_NAME_SIZE 64
+
+/* Printed GUID with terminating zero */
+#define GUID_STRING_SIZE 37
+
+/* Decompressed data kept by one index, sections past it are left compressed */
+#define FIRMWARE_MAX_DECOMPRESSED (256 * 1024 * 1024)
+
+/* One FFS file of a firmware volume */
+typedef struct
+{
+    uint8_t guid[16];
+    uint8_t type;
+    char    name[FIRMWARE_NAME_SIZE];  /* From user interface section, empty if there is none */
+    const uint8_t* file;               /* File header */
+    size_t  file_size;                 /* Header included */
+    const uint8_t* body;               /* PE32 or TE section, raw data of other files, NULL if none */
+    size_t  body_size;
+    uint8_t compressed;                /* Has sections that can't be decompressed */
+} firmware_module;
+
+/* Contents of a compressed section, modules inside point here.
+*  Data has IMAGE_GUARD_SIZE bytes of zeroes before and after it, like loaded images */
+typedef struct
+{
+    uint8_t* data;
+    size_t   size;
+} firmware_buffer;
+
+/* Every FFS file of every firmware volume of an image, nested volumes included */
+typedef struct
+{
+    firmware_module* modules;  /* In image order */
+    size_t  count;
+    size_t  capacity;
+    const firmware_module** by_guid;  /* Modules sorted by GUID, then by image order */
+    size_t  volumes;
+    firmware_buffer* buffers;  /* Decompressed sections in the order they were opened */
+    size_t  buffer_count;
+    size_t  buffer_capacity;
+    size_t  decompressed;      /* Bytes of all buffers */
+} firmware_index;
+
+/* Finds firmware volumes in buffer at 8-byte alignment and indexes their files,
+*  EFI, Tiano and LZMA compressed sections are decompressed and indexed too.
+*  The index is empty if there are none */
+uint8_t build_firmware_index(const uint8_t* buffer, size_t size, firmware_index* index);
+
+/* First module with guid in image order, NULL if there is none */
+const firmware_module* find_firmware_module(const firmware_index* index, const uint8_t* guid);
+
+void free_firmware_index(firmware_index* index);
+
+/* Prints GUID in registry format */
+void format_guid(char* string, const uint8_t* guid);
+
+#endif
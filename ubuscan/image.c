@@ -0,0 +1,256 @@
+#if !defined(_WIN32) && !defined(_FILE_OFFSET_BITS)
+#define _FILE_OFFSET_BITS 64
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "image.h"
+
+/* Size of chunks used to read pipes */
+#define IMAGE_CHUNK_SIZE (1024 * 1024)
+
+/* Reads stream of unknown size in chunks into zero-guarded buffer */
+static uint8_t read_stream(FILE* file, image_t* image)
+{
+    uint8_t* base = NULL;
+    uint8_t* grown;
+    size_t capacity = 0;
+    size_t size = 0;
+    size_t read;
+
+    for (;;)
+    {
+        if (capacity - size < IMAGE_CHUNK_SIZE)
+        {
+            capacity = capacity ? capacity * 2 : IMAGE_CHUNK_SIZE;
+            grown = (uint8_t*) realloc(base, IMAGE_GUARD_SIZE + capacity + IMAGE_GUARD_SIZE);
+            if (!grown)
+            {
+                free(base);
+                return IMAGE_ERR_OUT_OF_MEMORY;
+            }
+            if (!base)
+                memset(grown, 0, IMAGE_GUARD_SIZE);
+            base = grown;
+        }
+
+        read = fread(base + IMAGE_GUARD_SIZE + size, 1, capacity - size, file);
+        size += read;
+        if (read == 0)
+            break;
+    }
+
+    if (ferror(file))
+    {
+        free(base);
+        return IMAGE_ERR_FILE_READ;
+    }
+
+    memset(base + IMAGE_GUARD_SIZE + size, 0, IMAGE_GUARD_SIZE);
+    image->base = base;
+    image->reserved = IMAGE_GUARD_SIZE + capacity + IMAGE_GUARD_SIZE;
+    image->data = base + IMAGE_GUARD_SIZE;
+    image->size = size;
+    image->mapped = 0;
+    return IMAGE_SUCCESS;
+}
+
+static uint8_t read_file_stream(const char* filename, image_t* image)
+{
+    FILE* file;
+    uint8_t result;
+
+    if (!strcmp(filename, "-"))
+    {
+#ifdef _WIN32
+        _setmode(_fileno(stdin), _O_BINARY);
+#endif
+        return read_stream(stdin, image);
+    }
+
+    file = fopen(filename, "rb");
+    if (!file)
+        return IMAGE_ERR_FILE_OPEN;
+
+    result = read_stream(file, image);
+    fclose(file);
+    return result;
+}
+
+#ifdef _WIN32
+/* Largest single read, ReadFile takes 32-bit sizes */
+#define IMAGE_READ_SIZE (64 * 1024 * 1024)
+
+/* Views of file mappings can't be placed between zeroed pages before Windows 10,
+*  so regular files are read whole into a zero-guarded buffer instead */
+uint8_t load_image(const char* filename, image_t* image, uint8_t mode)
+{
+    HANDLE file;
+    LARGE_INTEGER size;
+    uint8_t* base;
+    size_t total;
+    size_t done;
+    DWORD chunk;
+    DWORD read;
+
+    (void) mode; /* Buffer is a private copy, writable either way */
+    memset(image, 0, sizeof(*image));
+
+    if (!strcmp(filename, "-"))
+        return read_file_stream(filename, image);
+
+    file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                       OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return IMAGE_ERR_FILE_OPEN;
+
+    /* Pipes, devices and empty files are read as streams */
+    if (GetFileType(file) != FILE_TYPE_DISK || !GetFileSizeEx(file, &size) || size.QuadPart == 0)
+    {
+        CloseHandle(file);
+        return read_file_stream(filename, image);
+    }
+
+    if ((unsigned long long) size.QuadPart > (size_t) -1 - 2 * IMAGE_GUARD_SIZE)
+    {
+        CloseHandle(file);
+        return IMAGE_ERR_OUT_OF_MEMORY;
+    }
+
+    total = IMAGE_GUARD_SIZE + (size_t) size.QuadPart + IMAGE_GUARD_SIZE;
+    base = (uint8_t*) malloc(total);
+    if (!base)
+    {
+        CloseHandle(file);
+        return IMAGE_ERR_OUT_OF_MEMORY;
+    }
+
+    /* File may shrink while being read, the rest stays zeroed then */
+    memset(base, 0, IMAGE_GUARD_SIZE);
+    for (done = 0; done < (size_t) size.QuadPart; done += read)
+    {
+        chunk = (DWORD) ((size_t) size.QuadPart - done < IMAGE_READ_SIZE ?
+                         (size_t) size.QuadPart - done : IMAGE_READ_SIZE);
+        if (!ReadFile(file, base + IMAGE_GUARD_SIZE + done, chunk, &read, NULL))
+        {
+            free(base);
+            CloseHandle(file);
+            return IMAGE_ERR_FILE_READ;
+        }
+        if (read == 0)
+            break;
+    }
+    CloseHandle(file);
+    memset(base + IMAGE_GUARD_SIZE + done, 0, total - IMAGE_GUARD_SIZE - done);
+
+    image->base = base;
+    image->reserved = total;
+    image->data = base + IMAGE_GUARD_SIZE;
+    image->size = done;
+    image->mapped = 0;
+    return IMAGE_SUCCESS;
+}
+
+void free_image(image_t* image)
+{
+    free(image->base);
+    memset(image, 0, sizeof(*image));
+}
+#else
+uint8_t load_image(const char* filename, image_t* image, uint8_t mode)
+{
+    struct stat st;
+    size_t page;
+    size_t guard;
+    size_t size;
+    uint8_t* base;
+    void* view;
+    int prot;
+    int fd;
+
+    memset(image, 0, sizeof(*image));
+
+    if (!strcmp(filename, "-"))
+        return read_file_stream(filename, image);
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return IMAGE_ERR_FILE_OPEN;
+
+    /* Pipes, devices and empty files are read as streams */
+    if (fstat(fd, &st) || !S_ISREG(st.st_mode) || st.st_size == 0)
+    {
+        close(fd);
+        return read_file_stream(filename, image);
+    }
+
+    if ((unsigned long long) st.st_size > (size_t) -1 / 2)
+    {
+        close(fd);
+        return IMAGE_ERR_OUT_OF_MEMORY;
+    }
+    size = (size_t) st.st_size;
+
+    page = (size_t) sysconf(_SC_PAGESIZE);
+    guard = (IMAGE_GUARD_SIZE + page - 1) / page * page;
+    prot = PROT_READ | (mode == IMAGE_WRITABLE ? PROT_WRITE : 0);
+
+    /* Reserving zero-filled region with guard pages around the file,
+    *  then mapping the file over its middle */
+    image->reserved = guard + (size + page - 1) / page * page + guard;
+    base = (uint8_t*) mmap(NULL, image->reserved, prot, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == (uint8_t*) MAP_FAILED)
+    {
+        close(fd);
+        return IMAGE_ERR_OUT_OF_MEMORY;
+    }
+
+    view = mmap(base + guard, size, prot, MAP_PRIVATE | MAP_FIXED, fd, 0);
+    if (view == MAP_FAILED)
+    {
+        munmap(base, image->reserved);
+        close(fd);
+        return IMAGE_ERR_FILE_READ;
+    }
+
+    /* Images are scanned front to back, ask for aggressive read-ahead */
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+#ifdef MADV_SEQUENTIAL
+    madvise(view, size, MADV_SEQUENTIAL);
+#endif
+#ifdef MADV_WILLNEED
+    madvise(view, size, MADV_WILLNEED);
+#endif
+    close(fd);
+
+    image->base = base;
+    image->data = (uint8_t*) view;
+    image->size = size;
+    image->mapped = 1;
+    return IMAGE_SUCCESS;
+}
+
+void free_image(image_t* image)
+{
+    if (image->mapped)
+        munmap(image->base, image->reserved);
+    else
+        free(image->base);
+    memset(image, 0, sizeof(*image));
+}
+#endif
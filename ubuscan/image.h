@@ -0,0 +1,39 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Return codes, same values as ERR_* codes of the tools */
+#define IMAGE_SUCCESS         0
+#define IMAGE_ERR_FILE_OPEN   2
+#define IMAGE_ERR_FILE_READ   3
+#define IMAGE_ERR_OUT_OF_MEMORY 5
+
+/* Access modes */
+#define IMAGE_READ_ONLY 0
+#define IMAGE_WRITABLE  1 /* Private copy-on-write view, changes never reach the file */
+
+/* Bytes of zeroes guaranteed before and after image data on every system,
+*  so reads slightly out of bounds don't fault and see no stale bytes */
+#define IMAGE_GUARD_SIZE 4096
+
+/* File contents loaded into memory */
+typedef struct
+{
+    uint8_t* data;     /* First byte of file */
+    size_t   size;     /* File size */
+    void*    base;     /* Start of the mapping or allocation */
+    size_t   reserved; /* Size of the mapping or allocation */
+    uint8_t  mapped;
+} image_t;
+
+/* Loads file into memory, "-" stands for standard input
+*  Regular files are memory-mapped with sequential access hints on POSIX systems
+*  and read whole on Windows, pipes and devices are read in chunks */
+uint8_t load_image(const char* filename, image_t* image, uint8_t mode);
+
+/* Unmaps or frees image contents */
+void free_image(image_t* image);
+
+#endif
@@ -0,0 +1,146 @@
+#include "microcode.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MICROCODE_SSE2
+#include <emmintrin.h>
+#endif
+
+/* Update header, all fields are little-endian dwords */
+#define MC_HEADER_VERSION  0
+#define MC_REVISION        4
+#define MC_DATE            8
+#define MC_CPUID           12
+#define MC_CHECKSUM        16
+#define MC_LOADER_REVISION 20
+#define MC_PLATFORMS       24
+#define MC_DATA_SIZE       28
+#define MC_TOTAL_SIZE      32
+#define MC_RESERVED        36
+#define MC_HEADER_SIZE     48
+
+/* Sizes stored as zero in the oldest updates */
+#define MC_DEFAULT_DATA_SIZE  2000
+#define MC_DEFAULT_TOTAL_SIZE 2048
+
+static uint32_t read_dword(const uint8_t* data)
+{
+    return (uint32_t) data[0] | ((uint32_t) data[1] << 8) | ((uint32_t) data[2] << 16) | ((uint32_t) data[3] << 24);
+}
+
+/* Two BCD digits in range */
+static int bcd_in_range(uint32_t value, uint32_t low, uint32_t high)
+{
+    if ((value & 0x0F) > 9 || (value >> 4) > 9)
+        return 0;
+    value = (value >> 4) * 10 + (value & 0x0F);
+    return value >= low && value <= high;
+}
+
+/* Sum of size/4 dwords, zero for an intact update */
+static uint32_t checksum(const uint8_t* data, size_t size)
+{
+    uint32_t sum = 0;
+    size_t i = 0;
+#ifdef MICROCODE_SSE2
+    __m128i total = _mm_setzero_si128();
+    uint32_t lanes[4];
+
+    for (; i + 16 <= size; i += 16)
+        total = _mm_add_epi32(total, _mm_loadu_si128((const __m128i*) (data + i)));
+    _mm_storeu_si128((__m128i*) lanes, total);
+    sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif
+
+    for (; i + 4 <= size; i += 4)
+        sum += read_dword(data + i);
+    return sum;
+}
+
+/* Checks header at data, fills update if it is a valid one */
+static int read_header(const uint8_t* data, const uint8_t* end, microcode_update* update)
+{
+    uint32_t date, data_size, total_size;
+    size_t i;
+
+    if (read_dword(data + MC_HEADER_VERSION) != 1 || read_dword(data + MC_LOADER_REVISION) != 1)
+        return 0;
+
+    /* Date is 0xMMDDYYYY in BCD */
+    date = read_dword(data + MC_DATE);
+    if (!bcd_in_range(date >> 24, 1, 12) || !bcd_in_range((date >> 16) & 0xFF, 1, 31) ||
+        !bcd_in_range((date >> 8) & 0xFF, 19, 20) || !bcd_in_range(date & 0xFF, 0, 99))
+        return 0;
+
+    for (i = MC_RESERVED; i < MC_HEADER_SIZE; i++)
+        if (data[i])
+            return 0;
+
+    data_size = read_dword(data + MC_DATA_SIZE);
+    total_size = read_dword(data + MC_TOTAL_SIZE);
+    if (!data_size)
+        data_size = MC_DEFAULT_DATA_SIZE;
+    if (!total_size)
+        total_size = MC_DEFAULT_TOTAL_SIZE;
+    if (data_size % 4 || total_size % 1024 || total_size < MC_HEADER_SIZE ||
+        data_size > total_size - MC_HEADER_SIZE || total_size > (size_t) (end - data))
+        return 0;
+
+    update->header = data;
+    update->cpuid = read_dword(data + MC_CPUID);
+    update->platforms = read_dword(data + MC_PLATFORMS);
+    update->revision = read_dword(data + MC_REVISION);
+    update->date = date;
+    update->size = total_size;
+    update->checksum_valid = checksum(data, total_size) == 0;
+    return 1;
+}
+
+unsigned long find_microcode(const uint8_t* begin, const uint8_t* end, microcode_callback callback, void* context)
+{
+    microcode_update update;
+    const uint8_t* position = begin;
+    unsigned long found = 0;
+#ifdef MICROCODE_SSE2
+    const __m128i version = _mm_set1_epi32(1);
+    int mask;
+#endif
+
+    if (!begin || end - begin < MC_HEADER_SIZE)
+        return 0;
+
+    while ((size_t) (end - position) >= MC_HEADER_SIZE)
+    {
+#ifdef MICROCODE_SSE2
+        /* Skipping four dwords at a time while none of them is header version 1 */
+        if ((size_t) (end - position) >= MC_HEADER_SIZE + 16)
+        {
+            mask = _mm_movemask_epi8(_mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*) position), version));
+            if (!mask)
+            {
+                position += 16;
+                continue;
+            }
+            while (!(mask & 1))
+            {
+                mask >>= 4;
+                position += 4;
+            }
+        }
+#endif
+
+        if (read_header(position, end, &update))
+        {
+            found++;
+            if (callback && callback(context, &update))
+                break;
+            if (update.checksum_valid)
+            {
+                position += update.size;
+                continue;
+            }
+        }
+        position += 4;
+    }
+
+    return found;
+}
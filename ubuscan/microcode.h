@@ -0,0 +1,28 @@
+#ifndef MICROCODE_H
+#define MICROCODE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Intel microcode update found in image */
+typedef struct
+{
+    const uint8_t* header;    /* First byte of update header */
+    uint32_t cpuid;           /* Processor signature */
+    uint32_t platforms;       /* Processor flags, one bit per platform ID */
+    uint32_t revision;
+    uint32_t date;            /* BCD, 0xMMDDYYYY */
+    uint32_t size;            /* Total size, header included */
+    uint8_t  checksum_valid;  /* Dwords of the whole update sum to zero */
+} microcode_update;
+
+/* Called for every update found, nonzero return stops the walk */
+typedef int (*microcode_callback)(void* context, const microcode_update* update);
+
+/* Walks buffer at dword alignment for update headers with valid header version,
+*  loader revision, date and sizes, and checks the checksum of every one.
+*  Updates never overlap, so the walk continues after the end of every update
+*  with valid checksum. Returns the number of updates reported */
+unsigned long find_microcode(const uint8_t* begin, const uint8_t* end, microcode_callback callback, void* context);
+
+#endif
@@ -0,0 +1,381 @@
+#if !defined(_WIN32) && !defined(_FILE_OFFSET_BITS)
+#define _FILE_OFFSET_BITS 64
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include "ngram.h"
+
+#define NGRAM_MAGIC   0x58494255u /* "UBIX" in little-endian files */
+#define NGRAM_VERSION 2
+
+/* Gram hash buckets, about one per 16 bytes of image */
+#define NGRAM_MIN_BITS 10
+#define NGRAM_MAX_BITS 22
+
+/* Buckets with more positions than this or 1/256 of all grams are dropped */
+#define NGRAM_MIN_DROP 4096
+
+
+/* Index file starts with this header, followed by offsets, dropped flags and positions */
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t bucket_bits;
+    uint32_t reserved;
+    uint64_t image_size;
+    int64_t  image_mtime;  /* Nanoseconds, 100 ns steps on Windows */
+    int64_t  image_ctime;
+    uint64_t image_hash;
+    uint64_t positions;
+} ngram_header;
+
+static uint32_t gram_bucket(const uint8_t* data, unsigned bits)
+{
+    uint32_t gram;
+
+    memcpy(&gram, data, sizeof(gram));
+    return (gram * 0x9E3779B1u) >> (32 - bits);
+}
+
+static uint64_t hash_bytes(uint64_t hash, const uint8_t* data, size_t size)
+{
+    size_t i;
+
+    for (i = 0; i < size; i++)
+        hash = (hash ^ data[i]) * 0x100000001B3ull;
+    return hash;
+}
+
+/* Hash of all image contents, it catches writes that keep size and both times
+*  unchanged. Words go to four independent lanes, so it runs near memory speed */
+static uint64_t hash_contents(const uint8_t* data, size_t size)
+{
+    uint64_t lanes[4] = { 0xCBF29CE484222325ull, 0x84222325CBF29CE4ull, 0x9E3779B97F4A7C15ull, 0xC2B2AE3D27D4EB4Full };
+    uint64_t word, hash;
+    size_t i, j;
+
+    for (i = 0; i + 32 <= size; i += 32)
+    {
+        for (j = 0; j < 4; j++)
+        {
+            memcpy(&word, data + i + j * 8, sizeof(word));
+            lanes[j] = (lanes[j] ^ word) * 0x100000001B3ull;
+            lanes[j] ^= lanes[j] >> 29;
+        }
+    }
+
+    hash = hash_bytes(0xCBF29CE484222325ull, data + i, size - i);
+    for (j = 0; j < 4; j++)
+        hash = (hash ^ lanes[j]) * 0x100000001B3ull;
+    return hash ^ (uint64_t) size;
+}
+
+/* Modification and change times of image, as precise as the system keeps them */
+static void file_times(const char* image_name, const struct stat* info, int64_t* mtime, int64_t* ctime)
+{
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA attributes;
+
+    /* Windows keeps no change time, creation time changes when the file is replaced */
+    if (GetFileAttributesExA(image_name, GetFileExInfoStandard, &attributes))
+    {
+        *mtime = (int64_t) ((((uint64_t) attributes.ftLastWriteTime.dwHighDateTime << 32) |
+                             attributes.ftLastWriteTime.dwLowDateTime) * 100);
+        *ctime = (int64_t) ((((uint64_t) attributes.ftCreationTime.dwHighDateTime << 32) |
+                             attributes.ftCreationTime.dwLowDateTime) * 100);
+        return;
+    }
+    *mtime = (int64_t) info->st_mtime * 1000000000;
+    *ctime = (int64_t) info->st_ctime * 1000000000;
+#elif defined(__APPLE__)
+    (void) image_name;
+    *mtime = (int64_t) info->st_mtimespec.tv_sec * 1000000000 + info->st_mtimespec.tv_nsec;
+    *ctime = (int64_t) info->st_ctimespec.tv_sec * 1000000000 + info->st_ctimespec.tv_nsec;
+#else
+    (void) image_name;
+    *mtime = (int64_t) info->st_mtim.tv_sec * 1000000000 + info->st_mtim.tv_nsec;
+    *ctime = (int64_t) info->st_ctim.tv_sec * 1000000000 + info->st_ctim.tv_nsec;
+#endif
+}
+
+/* Fills header fields that identify the image */
+static uint8_t identify_image(const char* image_name, const image_t* image, ngram_header* header)
+{
+    struct stat info;
+
+    /* Positions are stored as 32-bit values */
+    if (!strcmp(image_name, "-") || stat(image_name, &info) || (uint64_t) info.st_size != (uint64_t) image->size)
+        return NGRAM_ERR_UNUSABLE;
+    if (image->size < 4 || (uint64_t) image->size > 0xFFFFFFFFull)
+        return NGRAM_ERR_UNUSABLE;
+
+    memset(header, 0, sizeof(*header));
+    header->magic = NGRAM_MAGIC;
+    header->version = NGRAM_VERSION;
+    header->image_size = (uint64_t) image->size;
+    file_times(image_name, &info, &header->image_mtime, &header->image_ctime);
+    header->image_hash = hash_contents(image->data, image->size);
+    return NGRAM_SUCCESS;
+}
+
+uint8_t ngram_build(const char* index_name, const char* image_name, const image_t* image)
+{
+    ngram_header header;
+    uint32_t* offsets;
+    uint32_t* fill;
+    uint32_t* positions;
+    uint8_t*  dropped;
+    size_t buckets, grams, limit, i;
+    uint32_t bucket, count;
+    char* temp_name;
+    FILE* file;
+    uint8_t result;
+
+    result = identify_image(image_name, image, &header);
+    if (result)
+        return result;
+
+    header.bucket_bits = NGRAM_MIN_BITS;
+    while (header.bucket_bits < NGRAM_MAX_BITS && ((size_t) 1 << header.bucket_bits) < image->size / 16)
+        header.bucket_bits++;
+    buckets = (size_t) 1 << header.bucket_bits;
+    grams = image->size - 3;
+    limit = grams / 256 > NGRAM_MIN_DROP ? grams / 256 : NGRAM_MIN_DROP;
+
+    offsets = (uint32_t*) calloc(buckets + 1, sizeof(uint32_t));
+    fill = (uint32_t*) malloc(buckets * sizeof(uint32_t));
+    dropped = (uint8_t*) calloc(buckets, 1);
+    if (!offsets || !fill || !dropped)
+    {
+        free(offsets);
+        free(fill);
+        free(dropped);
+        return NGRAM_ERR_OUT_OF_MEMORY;
+    }
+
+    /* Counting grams of every bucket, then turning counts into offsets */
+    for (i = 0; i < grams; i++)
+        offsets[gram_bucket(image->data + i, header.bucket_bits) + 1]++;
+    for (i = 0; i < buckets; i++)
+    {
+        count = offsets[i + 1];
+        if (count > limit)
+        {
+            dropped[i] = 1;
+            count = 0;
+        }
+        fill[i] = offsets[i];
+        offsets[i + 1] = offsets[i] + count;
+    }
+    header.positions = offsets[buckets];
+
+    positions = (uint32_t*) malloc((header.positions ? (size_t) header.positions : 1) * sizeof(uint32_t));
+    if (!positions)
+    {
+        free(offsets);
+        free(fill);
+        free(dropped);
+        return NGRAM_ERR_OUT_OF_MEMORY;
+    }
+
+    /* Positions are stored in file order, so every bucket is sorted */
+    for (i = 0; i < grams; i++)
+    {
+        bucket = gram_bucket(image->data + i, header.bucket_bits);
+        if (!dropped[bucket])
+            positions[fill[bucket]++] = (uint32_t) i;
+    }
+    free(fill);
+
+    /* Writing to temporary file first, so readers never see a partial index */
+    result = NGRAM_ERR_OUT_OF_MEMORY;
+    temp_name = (char*) malloc(strlen(index_name) + 5);
+    if (temp_name)
+    {
+        strcpy(temp_name, index_name);
+        strcat(temp_name, ".tmp");
+
+        result = NGRAM_ERR_FILE_OPEN;
+        file = fopen(temp_name, "wb");
+        if (file)
+        {
+            result = NGRAM_SUCCESS;
+            if (fwrite(&header, sizeof(header), 1, file) != 1 ||
+                fwrite(offsets, sizeof(uint32_t), buckets + 1, file) != buckets + 1 ||
+                fwrite(dropped, 1, buckets, file) != buckets ||
+                fwrite(positions, sizeof(uint32_t), (size_t) header.positions, file) != (size_t) header.positions)
+                result = NGRAM_ERR_FILE_READ;
+            if (fclose(file))
+                result = NGRAM_ERR_FILE_READ;
+
+#ifdef _WIN32
+            if (!result)
+                remove(index_name);
+#endif
+            if (!result && rename(temp_name, index_name))
+                result = NGRAM_ERR_FILE_OPEN;
+            if (result)
+                remove(temp_name);
+        }
+        free(temp_name);
+    }
+
+    free(offsets);
+    free(dropped);
+    free(positions);
+    return result;
+}
+
+uint8_t ngram_open(const char* index_name, const char* image_name, const image_t* image, ngram_index* index)
+{
+    ngram_header header, expected;
+    size_t buckets;
+    uint8_t result;
+
+    memset(index, 0, sizeof(*index));
+    result = identify_image(image_name, image, &expected);
+    if (result)
+        return result;
+
+    result = load_image(index_name, &index->file, IMAGE_READ_ONLY);
+    if (result)
+        return result;
+
+    /* Checking layout before trusting any offset */
+    result = NGRAM_ERR_STALE;
+    if (index->file.size >= sizeof(header))
+    {
+        memcpy(&header, index->file.data, sizeof(header));
+        buckets = (size_t) 1 << (header.bucket_bits & 31);
+        if (header.magic == NGRAM_MAGIC && header.version == NGRAM_VERSION &&
+            header.bucket_bits >= NGRAM_MIN_BITS && header.bucket_bits <= NGRAM_MAX_BITS &&
+            header.positions <= expected.image_size &&
+            index->file.size == sizeof(header) + (buckets + 1) * sizeof(uint32_t) + buckets +
+                                (size_t) header.positions * sizeof(uint32_t) &&
+            header.image_size == expected.image_size && header.image_mtime == expected.image_mtime &&
+            header.image_ctime == expected.image_ctime && header.image_hash == expected.image_hash)
+            result = NGRAM_SUCCESS;
+    }
+    if (result)
+    {
+        ngram_close(index);
+        return result;
+    }
+
+    index->bucket_bits = header.bucket_bits;
+    index->offsets = (const uint32_t*) (index->file.data + sizeof(header));
+    index->dropped = (const uint8_t*) (index->offsets + buckets + 1);
+    index->positions = (const uint32_t*) (index->dropped + buckets);
+    index->data = image->data;
+    index->size = image->size;
+    return NGRAM_SUCCESS;
+}
+
+uint8_t ngram_attach(const char* image_name, const image_t* image, ngram_index* index)
+{
+    char* index_name;
+    uint8_t result;
+
+    index_name = (char*) malloc(strlen(image_name) + sizeof(NGRAM_EXTENSION));
+    if (!index_name)
+        return NGRAM_ERR_OUT_OF_MEMORY;
+    strcpy(index_name, image_name);
+    strcat(index_name, NGRAM_EXTENSION);
+
+    result = ngram_open(index_name, image_name, image, index);
+    if (result && result != NGRAM_ERR_UNUSABLE)
+    {
+        result = ngram_build(index_name, image_name, image);
+        if (!result)
+            result = ngram_open(index_name, image_name, image, index);
+    }
+
+    free(index_name);
+    return result;
+}
+
+uint8_t ngram_foreach(const ngram_index* index, const uint8_t* pattern, const uint8_t* mask, size_t plen,
+                      match_callback callback, void* context, unsigned long* count)
+{
+    size_t offset, best_offset, i, k;
+    uint32_t bucket, best_bucket, size, best_size;
+    const uint8_t* start;
+    int usable;
+
+    *count = 0;
+    if (!index->offsets || !pattern || plen < 4)
+        return NGRAM_ERR_UNUSABLE;
+
+    /* Looking up the rarest gram with all bits fixed */
+    best_offset = 0;
+    best_bucket = 0;
+    best_size = 0;
+    usable = 0;
+    for (offset = 0; offset + 4 <= plen; offset++)
+    {
+        if (mask && (mask[offset] != 0xFF || mask[offset + 1] != 0xFF ||
+                     mask[offset + 2] != 0xFF || mask[offset + 3] != 0xFF))
+            continue;
+        bucket = gram_bucket(pattern + offset, index->bucket_bits);
+        if (index->dropped[bucket])
+            continue;
+        size = index->offsets[bucket + 1] - index->offsets[bucket];
+        if (!usable || size < best_size)
+        {
+            usable = 1;
+            best_offset = offset;
+            best_bucket = bucket;
+            best_size = size;
+        }
+    }
+    if (!usable)
+        return NGRAM_ERR_UNUSABLE;
+
+    /* Bucket holds other grams with the same hash too, every candidate is verified */
+    for (k = index->offsets[best_bucket]; k < index->offsets[best_bucket + 1]; k++)
+    {
+        if (index->positions[k] < best_offset || index->positions[k] - best_offset + plen > index->size)
+            continue;
+        start = index->data + index->positions[k] - best_offset;
+
+        if (mask)
+        {
+            for (i = 0; i < plen; i++)
+                if ((start[i] & mask[i]) != pattern[i])
+                    break;
+        }
+        else
+            i = memcmp(start, pattern, plen) ? 0 : plen;
+        if (i < plen)
+            continue;
+
+        (*count)++;
+        if (callback && callback(context, start))
+            break;
+    }
+
+    return NGRAM_SUCCESS;
+}
+
+uint8_t ngram_count(const ngram_index* index, const uint8_t* pattern, const uint8_t* mask, size_t plen,
+                    unsigned long* count)
+{
+    return ngram_foreach(index, pattern, mask, plen, NULL, NULL, count);
+}
+
+void ngram_close(ngram_index* index)
+{
+    if (index->file.base)
+        free_image(&index->file);
+    memset(index, 0, sizeof(*index));
+}
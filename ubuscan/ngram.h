@@ -0,0 +1,61 @@
+#ifndef NGRAM_H
+#define NGRAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "image.h"
+#include "search.h"
+
+/* Return codes, same values as ERR_* codes of the tools where they overlap */
+#define NGRAM_SUCCESS           0
+#define NGRAM_ERR_FILE_OPEN     2
+#define NGRAM_ERR_FILE_READ     3
+#define NGRAM_ERR_OUT_OF_MEMORY 5
+#define NGRAM_ERR_STALE         6 /* Index belongs to other contents of the file */
+#define NGRAM_ERR_UNUSABLE      7 /* Pattern or file can't be looked up, scan it instead */
+
+/* Extension added to image file name to get index file name */
+#define NGRAM_EXTENSION ".ubi"
+
+/* On-disk index of an image: every position of every 4-byte gram, grouped
+*  by gram hash, so a pattern is looked up through its rarest gram.
+*  Grams as frequent as padding are dropped, patterns made only of them
+*  are left to the linear scan. Index is keyed by file size, modification
+*  and change times to the nanosecond where the system keeps them and hash
+*  of all contents, and goes stale when any of them changes */
+typedef struct
+{
+    image_t file;               /* Mapped index file */
+    unsigned bucket_bits;
+    const uint32_t* offsets;    /* First position of every bucket, one more at the end */
+    const uint8_t*  dropped;    /* Nonzero for buckets of frequent grams */
+    const uint32_t* positions;  /* Gram positions of all buckets, ascending in every bucket */
+    const uint8_t*  data;       /* Indexed image */
+    size_t size;
+} ngram_index;
+
+/* Builds index of image loaded from image_name and writes it to index_name
+*  Images larger than 4 GB and standard input can't be indexed */
+uint8_t ngram_build(const char* index_name, const char* image_name, const image_t* image);
+
+/* Opens index_name and checks that it belongs to image loaded from image_name */
+uint8_t ngram_open(const char* index_name, const char* image_name, const image_t* image, ngram_index* index);
+
+/* Opens index stored next to the image, building it first if it is missing or stale */
+uint8_t ngram_attach(const char* image_name, const image_t* image, ngram_index* index);
+
+/* Counts (overlapping) matches of pattern, mask is as for find_masked_pattern
+*  Returns NGRAM_ERR_UNUSABLE if pattern has no fixed 4-byte gram outside padding */
+uint8_t ngram_count(const ngram_index* index, const uint8_t* pattern, const uint8_t* mask, size_t plen,
+                    unsigned long* count);
+
+/* Calls callback for matches in file order until it returns nonzero,
+*  *count receives the number of matches reported */
+uint8_t ngram_foreach(const ngram_index* index, const uint8_t* pattern, const uint8_t* mask, size_t plen,
+                      match_callback callback, void* context, unsigned long* count);
+
+/* Unmaps index */
+void ngram_close(ngram_index* index);
+
+#endif
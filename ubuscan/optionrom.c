@@ -0,0 +1,90 @@
+#include "optionrom.h"
+
+/* ROM header, all fields are little-endian */
+#define ROM_SIGNATURE       0xAA55
+#define ROM_EFI_SIGNATURE   0x00000EF1
+#define ROM_EFI_HEADER      0x04
+#define ROM_EFI_MACHINE     0x0A
+#define ROM_EFI_COMPRESSION 0x0C
+#define ROM_EFI_OFFSET      0x16
+#define ROM_PCIR_OFFSET     0x18
+#define ROM_HEADER_SIZE     0x1A
+
+/* PCI data structure */
+#define PCIR_SIGNATURE      0x52494350 /* "PCIR" */
+#define PCIR_VENDOR         0x04
+#define PCIR_DEVICE         0x06
+#define PCIR_IMAGE_LENGTH   0x10
+#define PCIR_CODE_TYPE      0x14
+#define PCIR_INDICATOR      0x15
+#define PCIR_SIZE           0x18
+
+#define ROM_BLOCK_SIZE      512
+#define ROM_LAST_IMAGE      0x80
+
+static uint16_t read_word(const uint8_t* data)
+{
+    return (uint16_t) (data[0] | (data[1] << 8));
+}
+
+static uint32_t read_dword(const uint8_t* data)
+{
+    return (uint32_t) data[0] | ((uint32_t) data[1] << 8) | ((uint32_t) data[2] << 16) | ((uint32_t) data[3] << 24);
+}
+
+unsigned long walk_option_rom(const uint8_t* buffer, size_t size, option_rom_callback callback, void* context)
+{
+    option_rom_image image;
+    const uint8_t* pcir;
+    size_t offset = 0, left, length;
+    unsigned long found = 0;
+
+    if (!buffer)
+        return 0;
+
+    while (size - offset >= ROM_HEADER_SIZE)
+    {
+        image.begin = buffer + offset;
+        left = size - offset;
+        if (read_word(image.begin) != ROM_SIGNATURE)
+            break;
+
+        /* PCI data structure is required, images without it end the chain */
+        length = read_word(image.begin + ROM_PCIR_OFFSET);
+        if (length > left || left - length < PCIR_SIZE)
+            break;
+        pcir = image.begin + length;
+        if (read_dword(pcir) != PCIR_SIGNATURE)
+            break;
+
+        image.vendor = read_word(pcir + PCIR_VENDOR);
+        image.device = read_word(pcir + PCIR_DEVICE);
+        image.code_type = pcir[PCIR_CODE_TYPE];
+        image.last = (pcir[PCIR_INDICATOR] & ROM_LAST_IMAGE) != 0;
+        length = (size_t) read_word(pcir + PCIR_IMAGE_LENGTH) * ROM_BLOCK_SIZE;
+        if (!length)
+            break;
+        image.end = length < left ? image.begin + length : buffer + size;
+
+        image.machine = 0;
+        image.compressed = 0;
+        image.efi = NULL;
+        if (image.code_type == ROM_CODE_EFI && read_dword(image.begin + ROM_EFI_HEADER) == ROM_EFI_SIGNATURE)
+        {
+            image.machine = read_word(image.begin + ROM_EFI_MACHINE);
+            image.compressed = read_word(image.begin + ROM_EFI_COMPRESSION) != 0;
+            length = read_word(image.begin + ROM_EFI_OFFSET);
+            if (length < (size_t) (image.end - image.begin))
+                image.efi = image.begin + length;
+        }
+
+        found++;
+        if (callback && callback(context, &image))
+            break;
+        if (image.last || image.end == buffer + size)
+            break;
+        offset = (size_t) (image.end - buffer);
+    }
+
+    return found;
+}
@@ -0,0 +1,36 @@
+#ifndef OPTIONROM_H
+#define OPTIONROM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Code types of PCI data structure */
+#define ROM_CODE_LEGACY 0x00
+#define ROM_CODE_OPEN_FIRMWARE 0x01
+#define ROM_CODE_HP_PA_RISC 0x02
+#define ROM_CODE_EFI 0x03
+
+/* One image of PCI option ROM */
+typedef struct
+{
+    const uint8_t* begin;     /* First byte of 0x55AA header */
+    const uint8_t* end;       /* End of image, clamped to the buffer */
+    uint16_t vendor;
+    uint16_t device;
+    uint8_t  code_type;
+    uint8_t  last;            /* Last image indicator */
+    /* EFI images only */
+    uint16_t machine;         /* PE machine type */
+    uint8_t  compressed;
+    const uint8_t* efi;       /* PE image, NULL if it is outside the image */
+} option_rom_image;
+
+/* Called for every image found, nonzero return stops the walk */
+typedef int (*option_rom_callback)(void* context, const option_rom_image* image);
+
+/* Follows chain of 0x55AA images with PCIR structures from the start of buffer
+*  until the last image indicator or the end of buffer.
+*  Returns the number of images reported, 0 if buffer is not an option ROM */
+unsigned long walk_option_rom(const uint8_t* buffer, size_t size, option_rom_callback callback, void* context);
+
+#endif
@@ -0,0 +1,97 @@
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "pattern.h"
+
+/* Converts one hex digit or ? wildcard to value and mask nibbles */
+static uint8_t read_nibble(char digit, uint8_t* value, uint8_t* mask)
+{
+    if (digit == '?')
+    {
+        *value = 0;
+        *mask = 0;
+        return PATTERN_SUCCESS;
+    }
+
+    if (!isxdigit((unsigned char) digit))
+        return PATTERN_ERR_INVALID;
+
+    *value = (uint8_t) (isdigit((unsigned char) digit) ? digit - '0' : toupper((unsigned char) digit) - 'A' + 10);
+    *mask = 0x0F;
+    return PATTERN_SUCCESS;
+}
+
+uint8_t read_pattern(const char* string, uint8_t* pattern[], uint8_t* mask[], size_t* length)
+{
+    size_t  i;
+    const char* current;
+    uint8_t high, low, high_mask, low_mask;
+    uint8_t masked = 0;
+
+    *length = strlen(string);
+    if (*length % 2)
+        return PATTERN_ERR_INVALID;
+
+    *length /= 2;
+
+    *pattern = (uint8_t*) malloc(*length ? *length : 1);
+    if (mask)
+        *mask = (uint8_t*) malloc(*length ? *length : 1);
+    if (!*pattern || (mask && !*mask))
+        return PATTERN_ERR_OUT_OF_MEMORY;
+
+    for (current = string, i = 0; i < *length; i++)
+    {
+        if (read_nibble(*current++, &high, &high_mask) || read_nibble(*current++, &low, &low_mask))
+            return PATTERN_ERR_INVALID;
+
+        if (high_mask != 0x0F || low_mask != 0x0F)
+        {
+            if (!mask)
+                return PATTERN_ERR_INVALID;
+            masked = 1;
+        }
+
+        (*pattern)[i] = (uint8_t) (high << 4 | low);
+        if (mask)
+            (*mask)[i] = (uint8_t) (high_mask << 4 | low_mask);
+    }
+
+    /* Literal patterns need no mask */
+    if (mask && !masked)
+    {
+        free(*mask);
+        *mask = NULL;
+    }
+
+    return PATTERN_SUCCESS;
+}
+
+char* next_field(char** cursor)
+{
+    char* field;
+    char* current = *cursor;
+
+    while (*current == ' ' || *current == '\t')
+        current++;
+    if (!*current)
+        return NULL;
+
+    if (*current == '"')
+    {
+        field = ++current;
+        while (*current && *current != '"')
+            current++;
+    }
+    else
+    {
+        field = current;
+        while (*current && *current != ' ' && *current != '\t')
+            current++;
+    }
+    if (*current)
+        *current++ = 0;
+    *cursor = current;
+    return field;
+}
@@ -0,0 +1,23 @@
+#ifndef PATTERN_H
+#define PATTERN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Return codes, same values as ERR_* codes of the tools */
+#define PATTERN_SUCCESS           0
+#define PATTERN_ERR_INVALID       4
+#define PATTERN_ERR_OUT_OF_MEMORY 5
+
+/* Converts ASCII-string to hexadecimal pattern
+*  ? stands for any nibble, so ?? matches any byte and 4? or ?4 match one nibble.
+*  If mask is NULL wildcards are rejected, otherwise *mask receives bits
+*  that must match for every byte, or NULL if pattern has no wildcards.
+*  Pattern bits outside the mask are zero */
+uint8_t read_pattern(const char* string, uint8_t* pattern[], uint8_t* mask[], size_t* length);
+
+/* Splits next whitespace-separated field off line and advances cursor past it
+*  Field may be quoted to keep spaces. Returns NULL when line has no more fields */
+char* next_field(char** cursor);
+
+#endif
@@ -0,0 +1,115 @@
+#include <string.h>
+
+#include "pe.h"
+
+/* Header layouts, all fields are little-endian */
+#define DOS_SIGNATURE        0x5A4D /* "MZ" */
+#define DOS_PE_OFFSET        0x3C
+#define DOS_HEADER_SIZE      0x40
+#define PE_SIGNATURE         0x00004550 /* "PE\0\0" */
+#define COFF_MACHINE         4
+#define COFF_SECTION_COUNT   6
+#define COFF_OPTIONAL_SIZE   20
+#define COFF_HEADER_SIZE     24 /* Signature included */
+#define TE_SIGNATURE         0x5A56 /* "VZ" */
+#define TE_MACHINE           2
+#define TE_SECTION_COUNT     4
+#define TE_STRIPPED_SIZE     6
+#define TE_HEADER_SIZE       40
+#define SECTION_RAW_SIZE     16
+#define SECTION_RAW_OFFSET   20
+#define SECTION_FLAGS        36
+#define SECTION_HEADER_SIZE  40
+
+static uint16_t read_word(const uint8_t* data)
+{
+    return (uint16_t) (data[0] | (data[1] << 8));
+}
+
+static uint32_t read_dword(const uint8_t* data)
+{
+    return (uint32_t) data[0] | ((uint32_t) data[1] << 8) | ((uint32_t) data[2] << 16) | ((uint32_t) data[3] << 24);
+}
+
+/* Reads section table at table, raw offsets are shifted back by bias bytes */
+static void read_sections(const uint8_t* buffer, size_t size, const uint8_t* table, size_t count,
+                          size_t bias, pe_image* image)
+{
+    const uint8_t* header;
+    pe_section* section;
+    uint32_t offset, length;
+    size_t i;
+
+    if (count > PE_MAX_SECTIONS)
+        count = PE_MAX_SECTIONS;
+    if (count > (size - (size_t) (table - buffer)) / SECTION_HEADER_SIZE)
+        count = (size - (size_t) (table - buffer)) / SECTION_HEADER_SIZE;
+
+    for (i = 0; i < count; i++)
+    {
+        header = table + i * SECTION_HEADER_SIZE;
+        section = &image->sections[image->section_count++];
+        memcpy(section->name, header, 8);
+        section->name[8] = 0;
+        section->characteristics = read_dword(header + SECTION_FLAGS);
+
+        /* Sections without raw data or outside the buffer are empty */
+        offset = read_dword(header + SECTION_RAW_OFFSET);
+        length = read_dword(header + SECTION_RAW_SIZE);
+        if (!length || offset < bias || offset - bias >= size)
+        {
+            section->begin = section->end = NULL;
+            continue;
+        }
+        section->begin = buffer + (offset - bias);
+        section->end = length > size - (offset - bias) ? buffer + size : section->begin + length;
+
+        if (!image->begin || section->begin < image->begin)
+            image->begin = section->begin;
+        if (!image->end || section->end > image->end)
+            image->end = section->end;
+    }
+}
+
+uint8_t parse_pe(const uint8_t* buffer, size_t size, pe_image* image)
+{
+    const uint8_t* coff;
+    uint32_t offset;
+    uint16_t stripped;
+
+    memset(image, 0, sizeof(pe_image));
+    if (!buffer || size < DOS_HEADER_SIZE)
+        return PE_NOT_FOUND;
+
+    if (read_word(buffer) == DOS_SIGNATURE)
+    {
+        offset = read_dword(buffer + DOS_PE_OFFSET);
+        if (offset > size || size - offset < COFF_HEADER_SIZE)
+            return PE_NOT_FOUND;
+        coff = buffer + offset;
+        if (read_dword(coff) != PE_SIGNATURE)
+            return PE_NOT_FOUND;
+
+        image->machine = read_word(coff + COFF_MACHINE);
+        offset += COFF_HEADER_SIZE + read_word(coff + COFF_OPTIONAL_SIZE);
+        if (offset > size)
+            return PE_NOT_FOUND;
+        read_sections(buffer, size, buffer + offset, read_word(coff + COFF_SECTION_COUNT), 0, image);
+        return PE_SUCCESS;
+    }
+
+    /* TE headers replace DOS, PE and optional headers, raw offsets still count them */
+    if (read_word(buffer) == TE_SIGNATURE)
+    {
+        stripped = read_word(buffer + TE_STRIPPED_SIZE);
+        if (stripped < TE_HEADER_SIZE)
+            return PE_NOT_FOUND;
+        image->machine = read_word(buffer + TE_MACHINE);
+        image->terse = 1;
+        read_sections(buffer, size, buffer + TE_HEADER_SIZE, buffer[TE_SECTION_COUNT],
+                      stripped - TE_HEADER_SIZE, image);
+        return PE_SUCCESS;
+    }
+
+    return PE_NOT_FOUND;
+}
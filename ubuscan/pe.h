@@ -0,0 +1,46 @@
+#ifndef PE_H
+#define PE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Return codes */
+#define PE_SUCCESS   0
+#define PE_NOT_FOUND 1 /* Buffer is not a PE or TE image */
+
+/* Machine types */
+#define PE_MACHINE_I386  0x014C
+#define PE_MACHINE_X64   0x8664
+#define PE_MACHINE_EBC   0x0EBC
+
+/* Section characteristics */
+#define PE_SECTION_CODE             0x00000020
+#define PE_SECTION_INITIALIZED_DATA 0x00000040
+
+/* Sections past this number are ignored */
+#define PE_MAX_SECTIONS 32
+
+/* Raw data of one section, clamped to the buffer */
+typedef struct
+{
+    char name[9];
+    uint32_t characteristics;
+    const uint8_t* begin;
+    const uint8_t* end;
+} pe_section;
+
+/* Headers of PE32, PE32+ or TE image */
+typedef struct
+{
+    uint16_t machine;
+    uint8_t  terse;          /* TE image, section offsets are adjusted for stripped headers */
+    size_t   section_count;
+    pe_section sections[PE_MAX_SECTIONS];
+    const uint8_t* begin;    /* Span of raw data of all sections, headers and */
+    const uint8_t* end;      /* trailing data like certificates are outside */
+} pe_image;
+
+/* Parses headers of image at the start of buffer, nothing past size is read */
+uint8_t parse_pe(const uint8_t* buffer, size_t size, pe_image* image);
+
+#endif
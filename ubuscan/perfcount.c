@@ -0,0 +1,139 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <string.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "perfcount.h"
+
+static const char* const counter_names[PERFCOUNT_COUNT] = {
+    "cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses"
+};
+
+#ifdef __linux__
+
+/* Counter descriptors, -1 for counters that couldn't be opened */
+static int counters[PERFCOUNT_COUNT] = { -1, -1, -1, -1, -1 };
+
+/* Opens counter of calling process and threads it starts later, stopped */
+static int open_counter(uint32_t type, uint64_t config)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+uint8_t perfcount_open(void)
+{
+    size_t i;
+    int opened = 0;
+
+    counters[PERFCOUNT_CYCLES] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    counters[PERFCOUNT_INSTRUCTIONS] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    counters[PERFCOUNT_L1D_MISSES] = open_counter(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+        (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+    counters[PERFCOUNT_LLC_MISSES] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    counters[PERFCOUNT_BRANCH_MISSES] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+
+    for (i = 0; i < PERFCOUNT_COUNT; i++)
+        if (counters[i] >= 0)
+            opened = 1;
+    return opened ? PERFCOUNT_SUCCESS : PERFCOUNT_ERR_UNAVAILABLE;
+}
+
+void perfcount_resume(void)
+{
+    size_t i;
+
+    for (i = 0; i < PERFCOUNT_COUNT; i++)
+        if (counters[i] >= 0)
+            ioctl(counters[i], PERF_EVENT_IOC_ENABLE, 0);
+}
+
+void perfcount_pause(void)
+{
+    size_t i;
+
+    for (i = 0; i < PERFCOUNT_COUNT; i++)
+        if (counters[i] >= 0)
+            ioctl(counters[i], PERF_EVENT_IOC_DISABLE, 0);
+}
+
+void perfcount_read(perfcount_values* values)
+{
+    uint64_t data[3]; /* Value, time enabled, time running */
+    size_t i;
+
+    memset(values, 0, sizeof(*values));
+    for (i = 0; i < PERFCOUNT_COUNT; i++)
+    {
+        if (counters[i] < 0 || read(counters[i], data, sizeof(data)) != (ssize_t) sizeof(data))
+            continue;
+        values->available[i] = 1;
+
+        /* Counters that shared the PMU with others ran part of the time */
+        if (data[2] && data[2] < data[1])
+            data[0] = (uint64_t) ((double) data[0] * data[1] / data[2]);
+        values->values[i] = data[0];
+    }
+}
+
+void perfcount_close(void)
+{
+    size_t i;
+
+    for (i = 0; i < PERFCOUNT_COUNT; i++)
+    {
+        if (counters[i] >= 0)
+            close(counters[i]);
+        counters[i] = -1;
+    }
+}
+
+#else
+
+/* Counters are read through perf_event_open of Linux only */
+uint8_t perfcount_open(void)
+{
+    return PERFCOUNT_ERR_UNAVAILABLE;
+}
+
+void perfcount_resume(void)
+{
+}
+
+void perfcount_pause(void)
+{
+}
+
+void perfcount_read(perfcount_values* values)
+{
+    memset(values, 0, sizeof(*values));
+}
+
+void perfcount_close(void)
+{
+}
+
+#endif
+
+const char* perfcount_name(size_t counter)
+{
+    return counter < PERFCOUNT_COUNT ? counter_names[counter] : NULL;
+}
@@ -0,0 +1,41 @@
+#ifndef PERFCOUNT_H
+#define PERFCOUNT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Return codes, same values as ERR_* codes of the tools where they overlap */
+#define PERFCOUNT_SUCCESS         0
+#define PERFCOUNT_ERR_UNAVAILABLE 9 /* No counter could be opened: other OS, no PMU, not permitted */
+
+/* Hardware counters, in report order */
+#define PERFCOUNT_CYCLES        0
+#define PERFCOUNT_INSTRUCTIONS  1
+#define PERFCOUNT_L1D_MISSES    2
+#define PERFCOUNT_LLC_MISSES    3
+#define PERFCOUNT_BRANCH_MISSES 4
+#define PERFCOUNT_COUNT         5
+
+/* Counts of user space code of the process, threads started while counting included */
+typedef struct
+{
+    uint64_t values[PERFCOUNT_COUNT];     /* Scaled up when the kernel multiplexed counters */
+    uint8_t  available[PERFCOUNT_COUNT];  /* Counters the CPU or kernel don't offer stay zero */
+} perfcount_values;
+
+/* Opens every counter that is available, stopped. Must be called before
+*  threads are started, threads started later are counted too */
+uint8_t perfcount_open(void);
+
+/* Starts and stops all counters, threads already started included */
+void perfcount_resume(void);
+void perfcount_pause(void);
+
+/* Counts since perfcount_open, threads are counted after they end */
+void perfcount_read(perfcount_values* values);
+
+const char* perfcount_name(size_t counter);
+
+void perfcount_close(void);
+
+#endif
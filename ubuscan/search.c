@@ -0,0 +1,1142 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "search.h"
+#include "stats.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define SEARCH_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+#if defined(__GNUC__)
+#define TARGET_SSE2   __attribute__((target("sse2")))
+#define TARGET_AVX2   __attribute__((target("avx2,popcnt")))
+#define TARGET_AVX512 __attribute__((target("avx512f,avx512bw,popcnt")))
+#else
+#define TARGET_SSE2
+#define TARGET_AVX2
+#define TARGET_AVX512
+#endif
+
+/* POPCNT is present on every CPU with AVX2 */
+#if defined(__GNUC__)
+#define POPCOUNT32(x) __builtin_popcount(x)
+#define POPCOUNT64(x) __builtin_popcountll(x)
+#elif defined(_MSC_VER) && defined(_M_X64)
+#define POPCOUNT32(x) __popcnt(x)
+#define POPCOUNT64(x) __popcnt64(x)
+#elif defined(_MSC_VER)
+#define POPCOUNT32(x) __popcnt(x)
+#define POPCOUNT64(x) (__popcnt((uint32_t) (x)) + __popcnt((uint32_t) ((x) >> 32)))
+#endif
+
+/* Patterns up to this length are counted by comparing every byte at every position */
+#define SHORT_PATTERN_LENGTH 4
+
+/* Everything engines need to know about a pattern, computed once by compile_pattern
+*  and only read afterwards, so one compiled pattern can be used by many threads */
+struct compiled_pattern
+{
+    const uint8_t* pattern;
+    const uint8_t* mask;       /* NULL for literal patterns */
+    size_t  length;
+    uint8_t repetitive;        /* Searched with Two-Way algorithm */
+    size_t  split;             /* Critical factorization for Two-Way algorithm */
+    size_t  period;
+    size_t  first;             /* Anchor bytes of masked SIMD engines */
+    size_t  second;
+    size_t  bad_char_skip[256];
+};
+
+typedef const uint8_t* (*find_func)(const compiled_pattern* cp, const uint8_t* begin, const uint8_t* end);
+typedef unsigned long (*count_func)(const compiled_pattern* cp, const uint8_t* begin, const uint8_t* end);
+typedef unsigned long (*masked_func)(const compiled_pattern* cp, const uint8_t* begin, const uint8_t* end,
+                                     const uint8_t** found);
+
+/* Boyer-Moore-Horspool algorithm, used for short tails and on CPUs without SIMD engine */
+static const uint8_t* find_pattern_scalar(const compiled_pattern* cp, const uint8_t* begin, const uint8_t* end)
+{
+    const uint8_t* pattern = cp->pattern;
+    size_t plen = cp->length;
+    size_t scan = 0;
+    size_t last;
+    size_t slen;
+    stats_counters* stats = stats_thread();
+
+    if (plen == 0 || !begin || !end || end <= begin)
+        return NULL;
+
+    slen = end - begin;
+    last = plen - 1;
+
+    /* Positions whose last byte matches are the candidates */
+    while (slen >= plen)
+    {
+        if (stats && begin[last] == pattern[last])
+            stats->candidates++;
+        for (scan = last; begin[scan] == pattern[scan]; scan--)
+            if (scan == 0)
+                return begin;
+
+        slen    -= cp->bad_char_skip[begin[last]];
+        begin   += cp->bad_char_skip[begin[last]];
+    }
+
+    return NULL;
+}
+
+/* Counts all (overlapping) matches with Boyer-Moore-Horspool algorithm,
+*  Horspool shift is safe after a match as well, so the scan never restarts */
+static unsigned long count_pattern_scalar(const compiled_pattern* cp, const uint8_t* begin, const uint8_t* end)
+{
+    const uint8_t* pattern = cp->pattern;
+    size_t plen = cp->length;
+    size_t scan = 0;
+    size_t last;
+    size_t slen;
+    unsigned long count = 0;
+    stats_counters* stats = stats_thread();
+
+    if (plen == 0 || !begin || !end || end <= begin)
+        return 0;
+
+    slen = end - begin;
+    last = plen - 1;
+
+    while (slen >= plen)
+    {
+        if (stats && begin[last] == pattern[last])
+            stats->candidates++;
+        for (scan = last; begin[scan] == pattern[scan]; scan--)
+            if (scan == 0)
+            {
+                count++;
+                break;
+            }
+
+        slen    -= cp->bad_char_skip[begin[last]];
+        begin   += cp->bad_char_skip[begin[last]];
+    }
+
+    return count;
+}
+
+/* Masked patterns compare only mask bits, pattern bits outside the mask are zero */
+static int masked_equal_scalar(const uint8_t* data, const uint8_t* pattern, const uint8_t* mask, size_t plen)
+{
+    size_t i;
+
+    for (i = 0; i < plen; i++)
+        if ((data[i] & mask[i]) != pattern[i])
+            return 0;
+    return 1;
+}
+
+/* Boyer-Moore-Horspool algorithm for masked patterns, shift table gets
+*  every byte value accepted by the mask of every position but the last.
+*  Stores the first match to *found and stops if found is not NULL,
+*  otherwise counts all (overlapping) matches */
+static unsigned long masked_scan_scalar(const compiled_pattern* cp, const uint8_t* begin, const uint8_t* end,
+                                        const uint8_t** found)
+{
+    size_t plen = cp->length;
+    size_t last;
+    size_t slen;
+    unsigned long count = 0;
+    stats_counters* stats = stats_thread();
+
+    if (found)
+        *found = NULL;
+    if (plen == 0 || !begin || !end || end <= begin)
+        return 0;
+
+    slen = end - begin;
+    last = plen - 1;
+
+    /* Every position the shifts stop at is compared in full */
+    while (slen >= plen)
+    {
+        if (stats)
+            stats->candidates++;
+        if (masked_equal_scalar(begin, cp->pattern, cp->mask, plen))
+        {
+            count++;
+            if (found)
+            {
+                *found = begin;
+                return count;
+            }
+        }
+
+        slen    -= cp->bad_char_skip[begin[last]];
+        begin   += cp->bad_char_skip[begin[last]];
+    }
+
+    return count;
+}
+
+/* Critical factorization of pattern for Two-Way algorithm
+*  Computes maximal suffixes for both byte orders and returns the later split,
+*  period of the right part is stored to *period */
+static size_t maximal_suffix(const uint8_t* pattern, size_t plen, size_t* period, int reverse)
+{
+    size_t suffix = (size_t) -1; /* Start of maximal suffix minus one, wraps to 0 */
+    size_t j = 0;
+    size_t k = 1;
+    size_t p = 1;
+    uint8_t a, b;
+
+    while (j + k < plen)
+    {
+        a = pattern[j + k];
+        b = pattern[suffix + k];
+        if (reverse ? a > b : a < b)
+        {
+            /* Suffix is smaller, period is the whole prefix scanned so far */
+            j += k;
+            k = 1;
+            p = j - suffix;
+        }
+        else if (a == b)
+        {
+            /* Advancing through repetition of current period */
+            if (k != p)
+                k++;
+            else
+            {
+                j += p;
+                k = 1;
+            }
+        }
+        else
+        {
+            /* Suffix is larger, restarting from current position */
+            suffix = j++;
+            k = p = 1;
+        }
+    }
+
+    *period = p;
+    return suffix + 1;
+}
+
+static size_t critical_factorization(const uint8_t* pattern, size_t plen, size_t* period)
+{
+    size_t split, split_rev, period_rev;
+
+    if (plen < 3)
+    {
+        *period = 1;
+        return plen - 1;
+    }
+
+    split = maximal_suffix(pattern, plen, period, 0);
+    split_rev = maximal_suffix(pattern, plen, &period_rev, 1);
+    if (split_rev > split)
+    {
+        *period = period_rev;
+        return split_rev;
+    }
+    return split;
+}
+
+/* Two-Way algorithm of Crochemore and Perrin with Horspool shift on the last byte
+*  Runs in O(n + m) time regardless of pattern and data, so long runs of
+*  0x00 or 0xFF padding can't make it quadratic.
+*  Stores the first match to *found and stops if found is not NULL,
+*  otherwise counts all (overlapping) matches */
+static unsigned long twoway_scan(const compiled_pattern* cp, const uint8_t* begin, const uint8_t* end,
+                                 const uint8_t** found)
+{
+    const uint8_t* pattern = cp->pattern;
+    size_t plen = cp->length;
+    size_t split = cp->split;
+    size_t period = cp->period;
+    size_t slen, last, i, j, shift;
+    size_t memory = 0;
+    unsigned long count = 0;
+    stats_counters* stats = stats_thread();
+
+    if (found)
+        *found = NULL;
+    if (plen == 0 || !begin || !end || end <= begin)
+        return 0;
+
+    slen = end - begin;
+    last = plen - 1;
+
+    if (!memcmp(pattern, pattern + period, split))
+    {
+        /* Pattern is periodic, a mismatch in the left part moves by the period only,
+        *  memory holds the number of right-part bytes already known to match */
+        for (j = 0; j + plen <= slen;)
+        {
+            shift = begin[j + last] == pattern[last] ? 0 : cp->bad_char_skip[begin[j + last]];
+            if (shift)
+            {
+                /* Periodic pattern with one byte out of place can't match before it */
+                if (memory && shift < period)
+                    shift = plen - period;
+                memory = 0;
+                j += shift;
+                continue;
+            }
+            if (stats)
+                stats->candidates++;
+
+            /* Scanning right part, its last byte is known to match */
+            for (i = split > memory ? split : memory; i < last && pattern[i] == begin[j + i]; i++);
+            if (i < last)
+            {
+                j += i - split + 1;
+                memory = 0;
+                continue;
+            }
+
+            /* Scanning left part down to the remembered repetitions */
+            for (i = split; i > memory && pattern[i - 1] == begin[j + i - 1]; i--);
+            if (i <= memory)
+            {
+                count++;
+                if (found)
+                {
+                    *found = begin + j;
+                    return count;
+                }
+            }
+
+            /* Next match can't start before one period, right part stays matched */
+            j += period;
+            memory = plen - period;
+        }
+    }
+    else
+    {
+        /* Left and right parts differ, any mismatch gives the maximal shift */
+        period = (split > plen - split ? split : plen - split) + 1;
+        for (j = 0; j + plen <= slen;)
+        {
+            shift = begin[j + last] == pattern[last] ? 0 : cp->bad_char_skip[begin[j + last]];
+            if (shift)
+            {
+                j += shift;
+                continue;
+            }
+            if (stats)
+                stats->candidates++;
+
+            for (i = split; i < last && pattern[i] == begin[j + i]; i++);
+            if (i < last)
+            {
+                j += i - split + 1;
+                continue;
+            }
+
+            for (i = split; i > 0 && pattern[i - 1] == begin[j + i - 1]; i--);
+            if (i == 0)
+            {
+                count++;
+                if (found)
+                {
+                    *found = begin + j;
+                    return count;
+                }
+            }
+
+            /* Pattern period is longer than both parts, no match can start in between */
+            j += period;
+        }
+    }
+
+    return count;
+}
+
+/* Checks whether pattern makes first/last byte filters and Horspool shifts degrade
+*  on padding: pattern repeats itself at least twice, or its first and last bytes
+*  are its dominant byte, as in runs of 00 or FF */
+static int pattern_is_repetitive(const uint8_t* pattern, size_t plen, size_t split, size_t period)
+{
+    size_t frequency = 0;
+    size_t i;
+
+    if (period * 2 <= plen && !memcmp(pattern, pattern + period, split))
+        return 1;
+
+    if (pattern[0] != pattern[plen - 1])
+        return 0;
+
+    for (i = 0; i < plen; i++)
+        if (pattern[i] == pattern[0])
+            frequency++;
+    return frequency * 2 >= plen;
+}
+
+static unsigned long bit_count32(uint32_t mask)
+{
+    mask = mask - ((mask >> 1) & 0x55555555);
+    mask = (mask & 0x33333333) + ((mask >> 2) & 0x33333333);
+    return (((mask + (mask >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24;
+}
+
+/* Masked SIMD engines filter positions on two anchor bytes with the most fixed bits */
+static void masked_anchors(const uint8_t* mask, size_t plen, size_t* first, size_t* last)
+{
+    size_t i;
+    unsigned bits, best = 0;
+
+    *first = 0;
+    *last = plen - 1;
+    for (i = 0; i < plen; i++)
+    {
+        bits = bit_count32(mask[i]);
+        if (bits > best)
+        {
+            best = bits;
+            *first = *last = i;
+        }
+        else if (bits == best)
+            *last = i;
+    }
+}
+
+/* Fills compiled pattern for pattern and mask that must outlive it,
+*  compile_pattern keeps its own copy, one-shot wrappers use the caller's */
+static void prepare_pattern(compiled_pattern* cp, const uint8_t* pattern, const uint8_t* mask, size_t plen)
+{
+    size_t scan, last;
+    unsigned c;
+
+    cp->pattern = pattern;
+    cp->mask = mask;
+    cp->length = pattern ? plen : 0;
+    cp->repetitive = 0;
+    cp->split = 0;
+    cp->period = 1;
+    cp->first = 0;
+    cp->second = 0;
+    if (!cp->length)
+        return;
+
+    /* Horspool shift table, masked positions shift on every byte value they accept */
+    for (scan = 0; scan <= 255; scan++)
+        cp->bad_char_skip[scan] = plen;
+
+    last = plen - 1;
+
+    for (scan = 0; scan < last; scan++)
+    {
+        if (!mask || mask[scan] == 0xFF)
+            cp->bad_char_skip[pattern[scan]] = last - scan;
+        else
+            for (c = 0; c <= 255; c++)
+                if ((c & mask[scan]) == pattern[scan])
+                    cp->bad_char_skip[c] = last - scan;
+    }
+
+    if (mask)
+    {
+        masked_anchors(mask, plen, &cp->first, &cp->second);
+        return;
+    }
+
+    /* Low-entropy and periodic patterns go to the worst-case linear engine */
+    if (plen >= 3)
+    {
+        cp->split = critical_factorization(pattern, plen, &cp->period);
+        cp->repetitive = (uint8_t) pattern_is_repetitive(pattern, plen, cp->split, cp->period);
+    }
+}
+
+#ifdef SEARCH_X86
+static int lowest_bit32(uint32_t mask)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (int) index;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+static int lowest_bit64(uint64_t mask)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+    unsigned long index;
+    _BitScanForward64(&index, mask);
+    return (int) index;
+#elif defined(_MSC_VER)
+    return (uint32_t) mask ? lowest_bit32((uint32_t) mask) : 32 + lowest_bit32((uint32_t) (mask >> 32));
+#else
+    return __builtin_ctzll(mask);
+#endif
+}
+
+/* SIMD engines compare first and last pattern bytes at every position of a block,
+*  and confirm the candidates with memcmp of the remaining bytes.
+*  Blocks are processed while the last-byte load stays inside the buffer,
+*  the rest is handed to the scalar engine */
+TARGET_SSE2
+static const uint8_t* find_pattern_sse2(const compiled_pattern* cp, const uint8_t* begin, const uint8_t* end)
+{
+    const uint8_t* pattern = cp->pattern;
+    size_t plen = cp->length;
+    size_t slen, i, last;
+    uint32_t mask;
+    __m128i first_byte, last_byte, block_first, block_last;
+    stats_counters* stats = stats_thread();
+
+    if (plen == 0 || !begin || !end || end <= begin)
+        return NULL;
+    if (plen == 1)
+        return (const uint8_t*) memchr(begin, pattern[0], end - begin);
+
+    slen = end - begin;
+    last = plen - 1;
+    first_byte = _mm_set1_epi8((char) pattern[0]);
+    last_byte = _mm_set1_epi8((char) pattern[last]);
+
+    for (i = 0; i + last + 16 <= slen; i += 16)
+    {
+        block_first = _mm_loadu_si128((const __m128i*) (begin + i));
+        block_last = _mm_loadu_si128((const __m128i*) (begin + i + last));
+        mask = (uint32_t) _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(block_first, first_byte),
+                                                          _mm_cmpeq_epi8(block_last, last_byte)));
+        while (mask)
+        {
+            int bit = lowest_bit32(mask);
+            if (stats)
+                stats->candidates++;
+            if (!memcmp(begin + i + bit + 1, pattern + 1, plen - 2))
+                return begin + i + bit;
+            mask &= mask - 1;
+        }
+    }
+
+    return find_pattern_scalar(cp, begin + i, end);
+}
+
+TARGET_AVX2
+static const uint8_t* find_pattern_avx2(const compiled_pattern* cp, const uint8_t* begin, const uint8_t* end)
+{
+    const uint8_t* pattern = cp->pattern;
+    size_t plen = cp->length;
+    size_t slen, i, last;
+    uint32_t mask;
+    __m256i first_byte, last_byte, block_first, block_last;
+    stats_counters* stats = stats_thread();
+
+    if (plen == 0 || !begin || !end || end <= begin)
+        return NULL;
+    if (plen == 1)
+        return (const uint8_t*) memchr(begin, pattern[0], end - begin);
+
+    slen = end - begin;
+    last = plen - 1;
+    first_byte = _mm256_set1_epi8((char) pattern[0]);
+    last_byte = _mm256_set1_epi8((char) pattern[last]);
+
+    for (i = 0; i + last + 32 <= slen; i += 32)
+    {
+        block_first = _mm256_loadu_si256((const __m256i*) (begin + i));
+        block_last = _mm256_loadu_si256((const __m256i*) (begin + i + last));
+        mask = (uint32_t) _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(block_first, first_byte),
+                                                                _mm256_cmpeq_epi8(block_last, last_byte)));
+        while (mask)
+        {
+            int bit = lowest_bit32(mask);
+            if (stats)
+                stats->candidates++;
+            if (!memcmp(begin + i + bit + 1, pattern + 1, plen - 2))
+                return begin + i + bit;
+            mask &= mask - 1;
+        }
+    }
+
+    return find_pattern_sse2(cp, begin + i, end);
+}
+
+TARGET_AVX512
+static const uint8_t* find_pattern_avx512(const compiled_pattern* cp, const uint8_t* begin, const uint8_t* end)
+{
+    const uint8_t* pattern = cp->pattern;
+    size_t plen = cp->length;
+    size_t slen, i, last;
+    uint64_t mask;
+    __m512i first_byte, last_byte, block_first, block_last;
+    stats_counters* stats = stats_thread();
+
+    if (plen == 0 || !begin || !end || end <= begin)
+        return NULL;
+    if (plen == 1)
+        return (const uint8_t*) memchr(begin, pattern[0], end - begin);
+
+    slen = end - begin;
+    last = plen - 1;
+    first_byte = _mm512_set1_epi8((char) pattern[0]);
+    last_byte = _mm512_set1_epi8((char) pattern[last]);
+
+    for (i = 0; i + last + 64 <= slen; i += 64)
+    {
+        block_first = _mm512_loadu_si512((const void*) (begin + i));
+        block_last = _mm512_loadu_si512((const void*) (begin + i + last));
+        mask = _mm512_cmpeq_epi8_mask(block_first, first_byte) & _mm512_cmpeq_epi8_mask(block_last, last_byte);
+        while (mask)
+        {
+            int bit = lowest_bit64(mask);
+            if (stats)
+                stats->candidates++;
+            if (!memcmp(begin + i + bit + 1, pattern + 1, plen - 2))
+                return begin + i + bit;
+            mask &= mask - 1;
+        }
+    }
+
+    return find_pattern_sse2(cp, begin + i, end);
+}
+
+/* SIMD counting engines keep scanning after a match instead of restarting.
+*  Short patterns are compared at every position of a block and the matches
+*  are summed with popcount, so every position is a candidate.
+*  Longer ones use the first/last byte filter */
+TARGET_SSE2
+static unsigned long count_pattern_sse2(const compiled_pattern* cp, const uint8_t* begin, const uint8_t* end)
+{
+    const uint8_t* pattern = cp->pattern;
+    size_t plen = cp->length;
+    size_t slen, i, k, last;
+    uint32_t mask;
+    unsigned long count = 0;
+    __m128i bytes[SHORT_PATTERN_LENGTH];
+    __m128i equal;
+    stats_counters* stats = stats_thread();
+
+    if (plen == 0 || !begin || !end || end <= begin)
+        return 0;
+
+    slen = end - begin;
+    last = plen - 1;
+
+    if (plen <= SHORT_PATTERN_LENGTH)
+    {
+        for (k = 0; k < plen; k++)
+            bytes[k] = _mm_set1_epi8((char) pattern[k]);
+
+        for (i = 0; i + last + 16 <= slen; i += 16)
+        {
+            equal = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) (begin + i)), bytes[0]);
+            for (k = 1; k < plen; k++)
+                equal = _mm_and_si128(equal, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) (begin + i + k)), bytes[k]));
+            count += bit_count32((uint32_t) _mm_movemask_epi8(equal));
+        }
+        if (stats)
+            stats->candidates += i;
+    }
+    else
+    {
+        bytes[0] = _mm_set1_epi8((char) pattern[0]);
+        bytes[1] = _mm_set1_epi8((char) pattern[last]);
+
+        for (i = 0; i + last + 16 <= slen; i += 16)
+        {
+            equal = _mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) (begin + i)), bytes[0]),
+                                  _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) (begin + i + last)), bytes[1]));
+            for (mask = (uint32_t) _mm_movemask_epi8(equal); mask; mask &= mask - 1)
+            {
+                if (stats)
+                    stats->candidates++;
+                if (!memcmp(begin + i + lowest_bit32(mask) + 1, pattern + 1, plen - 2))
+                    count++;
+            }
+        }
+    }
+
+    return count + count_pattern_scalar(cp, begin + i, end);
+}
+
+TARGET_AVX2
+static unsigned long count_pattern_avx2(const compiled_pattern* cp, const uint8_t* begin, const uint8_t* end)
+{
+    const uint8_t* pattern = cp->pattern;
+    size_t plen = cp->length;
+    size_t slen, i, k, last;
+    uint32_t mask;
+    unsigned long count = 0;
+    __m256i bytes[SHORT_PATTERN_LENGTH];
+    __m256i equal;
+    stats_counters* stats = stats_thread();
+
+    if (plen == 0 || !begin || !end || end <= begin)
+        return 0;
+
+    slen = end - begin;
+    last = plen - 1;
+
+    if (plen <= SHORT_PATTERN_LENGTH)
+    {
+        for (k = 0; k < plen; k++)
+            bytes[k] = _mm256_set1_epi8((char) pattern[k]);
+
+        for (i = 0; i + last + 32 <= slen; i += 32)
+        {
+            equal = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*) (begin + i)), bytes[0]);
+            for (k = 1; k < plen; k++)
+                equal = _mm256_and_si256(equal, _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*) (begin + i + k)), bytes[k]));
+            count += POPCOUNT32((uint32_t) _mm256_movemask_epi8(equal));
+        }
+        if (stats)
+            stats->candidates += i;
+    }
+    else
+    {
+        bytes[0] = _mm256_set1_epi8((char) pattern[0]);
+        bytes[1] = _mm256_set1_epi8((char) pattern[last]);
+
+        for (i = 0; i + last + 32 <= slen; i += 32)
+        {
+            equal = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*) (begin + i)), bytes[0]),
+                                     _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*) (begin + i + last)), bytes[1]));
+            for (mask = (uint32_t) _mm256_movemask_epi8(equal); mask; mask &= mask - 1)
+            {
+                if (stats)
+                    stats->candidates++;
+                if (!memcmp(begin + i + lowest_bit32(mask) + 1, pattern + 1, plen - 2))
+                    count++;
+            }
+        }
+    }
+
+    return count + count_pattern_sse2(cp, begin + i, end);
+}
+
+TARGET_AVX512
+static unsigned long count_pattern_avx512(const compiled_pattern* cp, const uint8_t* begin, const uint8_t* end)
+{
+    const uint8_t* pattern = cp->pattern;
+    size_t plen = cp->length;
+    size_t slen, i, k, last;
+    uint64_t mask;
+    unsigned long count = 0;
+    __m512i bytes[SHORT_PATTERN_LENGTH];
+    stats_counters* stats = stats_thread();
+
+    if (plen == 0 || !begin || !end || end <= begin)
+        return 0;
+
+    slen = end - begin;
+    last = plen - 1;
+
+    if (plen <= SHORT_PATTERN_LENGTH)
+    {
+        for (k = 0; k < plen; k++)
+            bytes[k] = _mm512_set1_epi8((char) pattern[k]);
+
+        for (i = 0; i + last + 64 <= slen; i += 64)
+        {
+            mask = _mm512_cmpeq_epi8_mask(_mm512_loadu_si512((const void*) (begin + i)), bytes[0]);
+            for (k = 1; k < plen; k++)
+                mask &= _mm512_cmpeq_epi8_mask(_mm512_loadu_si512((const void*) (begin + i + k)), bytes[k]);
+            count += (unsigned long) POPCOUNT64(mask);
+        }
+        if (stats)
+            stats->candidates += i;
+    }
+    else
+    {
+        bytes[0] = _mm512_set1_epi8((char) pattern[0]);
+        bytes[1] = _mm512_set1_epi8((char) pattern[last]);
+
+        for (i = 0; i + last + 64 <= slen; i += 64)
+        {
+            mask = _mm512_cmpeq_epi8_mask(_mm512_loadu_si512((const void*) (begin + i)), bytes[0]) &
+                   _mm512_cmpeq_epi8_mask(_mm512_loadu_si512((const void*) (begin + i + last)), bytes[1]);
+            for (; mask; mask &= mask - 1)
+            {
+                if (stats)
+                    stats->candidates++;
+                if (!memcmp(begin + i + lowest_bit64(mask) + 1, pattern + 1, plen - 2))
+                    count++;
+            }
+        }
+    }
+
+    return count + count_pattern_sse2(cp, begin + i, end);
+}
+
+/* SIMD masked engines confirm candidates with masked compare 16 bytes at a time */
+TARGET_SSE2
+static int masked_equal_sse2(const uint8_t* data, const uint8_t* pattern, const uint8_t* mask, size_t plen)
+{
+    size_t i;
+    __m128i block;
+
+    for (i = 0; i + 16 <= plen; i += 16)
+    {
+        block = _mm_and_si128(_mm_loadu_si128((const __m128i*) (data + i)), _mm_loadu_si128((const __m128i*) (mask + i)));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(block, _mm_loadu_si128((const __m128i*) (pattern + i)))) != 0xFFFF)
+            return 0;
+    }
+
+    return masked_equal_scalar(data + i, pattern + i, mask + i, plen - i);
+}
+
+TARGET_SSE2
+static unsigned long masked_scan_sse2(const compiled_pattern* cp, const uint8_t* begin, const uint8_t* end,
+                                      const uint8_t** found)
+{
+    const uint8_t* pattern = cp->pattern;
+    const uint8_t* mask = cp->mask;
+    size_t plen = cp->length;
+    size_t first = cp->first;
+    size_t second = cp->second;
+    size_t slen, i;
+    uint32_t bits;
+    unsigned long count = 0;
+    __m128i first_byte, first_mask, second_byte, second_mask, equal;
+    stats_counters* stats = stats_thread();
+
+    if (found)
+        *found = NULL;
+    if (plen == 0 || !begin || !end || end <= begin)
+        return 0;
+
+    slen = end - begin;
+    first_byte = _mm_set1_epi8((char) pattern[first]);
+    first_mask = _mm_set1_epi8((char) mask[first]);
+    second_byte = _mm_set1_epi8((char) pattern[second]);
+    second_mask = _mm_set1_epi8((char) mask[second]);
+
+    for (i = 0; i + plen - 1 + 16 <= slen; i += 16)
+    {
+        equal = _mm_and_si128(
+            _mm_cmpeq_epi8(_mm_and_si128(_mm_loadu_si128((const __m128i*) (begin + i + first)), first_mask), first_byte),
+            _mm_cmpeq_epi8(_mm_and_si128(_mm_loadu_si128((const __m128i*) (begin + i + second)), second_mask), second_byte));
+        for (bits = (uint32_t) _mm_movemask_epi8(equal); bits; bits &= bits - 1)
+        {
+            if (stats)
+                stats->candidates++;
+            if (masked_equal_sse2(begin + i + lowest_bit32(bits), pattern, mask, plen))
+            {
+                count++;
+                if (found)
+                {
+                    *found = begin + i + lowest_bit32(bits);
+                    return count;
+                }
+            }
+        }
+    }
+
+    return count + masked_scan_scalar(cp, begin + i, end, found);
+}
+
+/* AVX-512 CPUs use this engine too, masked patterns are rare and short */
+TARGET_AVX2
+static unsigned long masked_scan_avx2(const compiled_pattern* cp, const uint8_t* begin, const uint8_t* end,
+                                      const uint8_t** found)
+{
+    const uint8_t* pattern = cp->pattern;
+    const uint8_t* mask = cp->mask;
+    size_t plen = cp->length;
+    size_t first = cp->first;
+    size_t second = cp->second;
+    size_t slen, i;
+    uint32_t bits;
+    unsigned long count = 0;
+    __m256i first_byte, first_mask, second_byte, second_mask, equal;
+    stats_counters* stats = stats_thread();
+
+    if (found)
+        *found = NULL;
+    if (plen == 0 || !begin || !end || end <= begin)
+        return 0;
+
+    slen = end - begin;
+    first_byte = _mm256_set1_epi8((char) pattern[first]);
+    first_mask = _mm256_set1_epi8((char) mask[first]);
+    second_byte = _mm256_set1_epi8((char) pattern[second]);
+    second_mask = _mm256_set1_epi8((char) mask[second]);
+
+    for (i = 0; i + plen - 1 + 32 <= slen; i += 32)
+    {
+        equal = _mm256_and_si256(
+            _mm256_cmpeq_epi8(_mm256_and_si256(_mm256_loadu_si256((const __m256i*) (begin + i + first)), first_mask), first_byte),
+            _mm256_cmpeq_epi8(_mm256_and_si256(_mm256_loadu_si256((const __m256i*) (begin + i + second)), second_mask), second_byte));
+        for (bits = (uint32_t) _mm256_movemask_epi8(equal); bits; bits &= bits - 1)
+        {
+            if (stats)
+                stats->candidates++;
+            if (masked_equal_sse2(begin + i + lowest_bit32(bits), pattern, mask, plen))
+            {
+                count++;
+                if (found)
+                {
+                    *found = begin + i + lowest_bit32(bits);
+                    return count;
+                }
+            }
+        }
+    }
+
+    return count + masked_scan_sse2(cp, begin + i, end, found);
+}
+
+static void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t regs[4])
+{
+#ifdef _MSC_VER
+    __cpuidex((int*) regs, (int) leaf, (int) subleaf);
+#else
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+/* Reads XCR0 to check that OS saves the wide registers */
+static uint64_t read_xcr0(void)
+{
+#ifdef _MSC_VER
+    return _xgetbv(0);
+#else
+    uint32_t eax, edx;
+    __asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return ((uint64_t) edx << 32) | eax;
+#endif
+}
+#endif
+
+/* Engine names, index is the engine level
+*  Two-Way engine is used for repetitive patterns on every level */
+static const char* const engine_names[] = { "scalar", "sse2", "avx2", "avx512" };
+static int engine_level = -1;
+
+static int detect_engine(void)
+{
+#ifdef SEARCH_X86
+    uint32_t regs[4];
+    uint32_t max_leaf;
+    uint64_t xcr0 = 0;
+    int level = 0;
+
+    cpuid(0, 0, regs);
+    max_leaf = regs[0];
+    if (max_leaf < 1)
+        return 0;
+
+    cpuid(1, 0, regs);
+    if (regs[3] & (1u << 26))                       /* SSE2 */
+        level = 1;
+    if (!(regs[2] & (1u << 27)) || !(regs[2] & (1u << 28)) || max_leaf < 7) /* OSXSAVE and AVX */
+        return level;
+
+    xcr0 = read_xcr0();
+    cpuid(7, 0, regs);
+    if ((xcr0 & 0x06) == 0x06 && (regs[1] & (1u << 5)))   /* YMM state and AVX2 */
+        level = 2;
+    if (level == 2 && (xcr0 & 0xE6) == 0xE6 &&            /* ZMM state, AVX512F and AVX512BW */
+        (regs[1] & (1u << 16)) && (regs[1] & (1u << 30)))
+        level = 3;
+    return level;
+#else
+    return 0;
+#endif
+}
+
+static find_func find_engine;
+static count_func count_engine;
+static masked_func masked_engine;
+
+/* Engines are selected on first call, racing threads store the same pointers */
+static void select_engines(void)
+{
+    if (engine_level < 0)
+        engine_level = detect_engine();
+
+    switch (engine_level)
+    {
+#ifdef SEARCH_X86
+    case 3:
+        masked_engine = masked_scan_avx2;
+        count_engine = count_pattern_avx512;
+        find_engine = find_pattern_avx512;
+        break;
+    case 2:
+        masked_engine = masked_scan_avx2;
+        count_engine = count_pattern_avx2;
+        find_engine = find_pattern_avx2;
+        break;
+    case 1:
+        masked_engine = masked_scan_sse2;
+        count_engine = count_pattern_sse2;
+        find_engine = find_pattern_sse2;
+        break;
+#endif
+    default:
+        masked_engine = masked_scan_scalar;
+        count_engine = count_pattern_scalar;
+        find_engine = find_pattern_scalar;
+        break;
+    }
+}
+
+compiled_pattern* compile_pattern(const uint8_t* pattern, const uint8_t* mask, size_t plen)
+{
+    compiled_pattern* cp;
+    uint8_t* copy;
+
+    if (!pattern || !plen)
+        return NULL;
+
+    /* Pattern and mask are copied right after the structure */
+    cp = (compiled_pattern*) malloc(sizeof(compiled_pattern) + (mask ? 2 : 1) * plen);
+    if (!cp)
+        return NULL;
+
+    copy = (uint8_t*) (cp + 1);
+    memcpy(copy, pattern, plen);
+    if (mask)
+        memcpy(copy + plen, mask, plen);
+
+    prepare_pattern(cp, copy, mask ? copy + plen : NULL, plen);
+    return cp;
+}
+
+void free_compiled_pattern(compiled_pattern* compiled)
+{
+    free(compiled);
+}
+
+size_t compiled_pattern_length(const compiled_pattern* compiled)
+{
+    return compiled->length;
+}
+
+uint8_t* search_compiled(const compiled_pattern* compiled, const uint8_t* begin, const uint8_t* end)
+{
+    const uint8_t* found;
+    stats_counters* stats = stats_thread();
+
+    if (!find_engine)
+        select_engines();
+
+    if (compiled->mask)
+        masked_engine(compiled, begin, end, &found);
+    else if (compiled->repetitive)
+        twoway_scan(compiled, begin, end, &found);
+    else
+        found = find_engine(compiled, begin, end);
+
+    /* Bytes up to the match are counted, the scan stops there */
+    if (stats)
+    {
+        stats->calls++;
+        if (end > begin)
+            stats->bytes += (uint64_t) ((found ? found + compiled->length : end) - begin);
+        stats->matches += found != NULL;
+    }
+    return (uint8_t*) found;
+}
+
+unsigned long count_compiled(const compiled_pattern* compiled, const uint8_t* begin, const uint8_t* end)
+{
+    stats_counters* stats = stats_thread();
+    unsigned long count;
+
+    if (!count_engine)
+        select_engines();
+
+    /* Short patterns are compared in full at every position anyway,
+    *  longer repetitive ones would make the byte filters check every position */
+    if (compiled->mask)
+        count = masked_engine(compiled, begin, end, NULL);
+    else if (compiled->repetitive && compiled->length > SHORT_PATTERN_LENGTH)
+        count = twoway_scan(compiled, begin, end, NULL);
+    else
+        count = count_engine(compiled, begin, end);
+
+    if (stats)
+    {
+        stats->calls++;
+        stats->bytes += end > begin ? (uint64_t) (end - begin) : 0;
+        stats->matches += count;
+    }
+    return count;
+}
+
+unsigned long foreach_compiled(const compiled_pattern* compiled, const uint8_t* begin, const uint8_t* end,
+                               match_callback callback, void* context)
+{
+    const uint8_t* found;
+    unsigned long count = 0;
+
+    for (found = search_compiled(compiled, begin, end); found; found = search_compiled(compiled, found + 1, end))
+    {
+        count++;
+        if (callback && callback(context, found))
+            break;
+    }
+
+    return count;
+}
+
+uint8_t* find_pattern(uint8_t* begin, uint8_t* end, const uint8_t* pattern, size_t plen)
+{
+    compiled_pattern cp;
+
+    prepare_pattern(&cp, pattern, NULL, plen);
+    return search_compiled(&cp, begin, end);
+}
+
+unsigned long count_pattern(const uint8_t* begin, const uint8_t* end, const uint8_t* pattern, size_t plen)
+{
+    compiled_pattern cp;
+
+    prepare_pattern(&cp, pattern, NULL, plen);
+    return count_compiled(&cp, begin, end);
+}
+
+uint8_t* find_masked_pattern(uint8_t* begin, uint8_t* end, const uint8_t* pattern,
+                             const uint8_t* mask, size_t plen)
+{
+    compiled_pattern cp;
+
+    prepare_pattern(&cp, pattern, mask, plen);
+    return search_compiled(&cp, begin, end);
+}
+
+unsigned long count_masked_pattern(const uint8_t* begin, const uint8_t* end, const uint8_t* pattern,
+                                   const uint8_t* mask, size_t plen)
+{
+    compiled_pattern cp;
+
+    prepare_pattern(&cp, pattern, mask, plen);
+    return count_compiled(&cp, begin, end);
+}
+
+const char* find_pattern_engine(void)
+{
+    if (engine_level < 0)
+        engine_level = detect_engine();
+    return engine_names[engine_level];
+}
+
+uint8_t select_search_engine(const char* name)
+{
+    int level, detected;
+
+    detected = detect_engine();
+    for (level = 0; level <= detected; level++)
+    {
+        if (!strcmp(name, engine_names[level]))
+        {
+            engine_level = level;
+            select_engines();
+            return 0;
+        }
+    }
+    return 1;
+}
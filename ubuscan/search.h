@@ -0,0 +1,60 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Implementation of GNU memmem function
+*  Returns pointer to the beginning of found pattern or NULL if not found
+*  Uses SSE2, AVX2 or AVX-512 engine picked at runtime for the CPU,
+*  falls back to Boyer-Moore-Horspool algorithm on other architectures.
+*  Periodic and low-entropy patterns (runs of 00 or FF) are searched with
+*  Two-Way algorithm, which stays linear on padding */
+uint8_t* find_pattern(uint8_t* begin, uint8_t* end, const uint8_t* pattern, size_t plen);
+
+/* Counts all (overlapping) matches of pattern between begin and end
+*  Same engines as find_pattern, but the scan continues after every match
+*  and patterns up to 4 bytes are counted with SIMD compare and popcount */
+unsigned long count_pattern(const uint8_t* begin, const uint8_t* end, const uint8_t* pattern, size_t plen);
+
+/* Same as find_pattern and count_pattern for patterns with wildcards,
+*  only bits set in mask are compared and pattern bits outside mask must be zero.
+*  NULL mask means literal pattern */
+uint8_t* find_masked_pattern(uint8_t* begin, uint8_t* end, const uint8_t* pattern,
+                             const uint8_t* mask, size_t plen);
+unsigned long count_masked_pattern(const uint8_t* begin, const uint8_t* end, const uint8_t* pattern,
+                                   const uint8_t* mask, size_t plen);
+
+/* Pattern prepared for repeated searches: shift tables, Two-Way factorization
+*  and SIMD anchors are computed once. Compiled pattern is never modified,
+*  so one can be shared by any number of threads */
+typedef struct compiled_pattern compiled_pattern;
+
+/* Called for every match found by foreach_compiled, nonzero return stops the scan */
+typedef int (*match_callback)(void* context, const uint8_t* match);
+
+/* Compiles pattern of plen bytes, mask follows the rules of find_masked_pattern
+*  and both are copied, so they can be freed afterwards.
+*  Returns NULL for empty pattern or if memory can't be allocated */
+compiled_pattern* compile_pattern(const uint8_t* pattern, const uint8_t* mask, size_t plen);
+void free_compiled_pattern(compiled_pattern* compiled);
+size_t compiled_pattern_length(const compiled_pattern* compiled);
+
+/* Same as find_masked_pattern, count_masked_pattern with a compiled pattern */
+uint8_t* search_compiled(const compiled_pattern* compiled, const uint8_t* begin, const uint8_t* end);
+unsigned long count_compiled(const compiled_pattern* compiled, const uint8_t* begin, const uint8_t* end);
+
+/* Calls callback for every (overlapping) match between begin and end in order,
+*  returns the number of matches reported */
+unsigned long foreach_compiled(const compiled_pattern* compiled, const uint8_t* begin, const uint8_t* end,
+                               match_callback callback, void* context);
+
+/* Name of the engine used by find_pattern on this CPU */
+const char* find_pattern_engine(void);
+
+/* Forces engine by name, for benchmarks and comparing engines on one machine
+*  Returns 0 on success or 1 if this CPU can't run the engine.
+*  Must not be called while other threads are searching */
+uint8_t select_search_engine(const char* name);
+
+#endif
@@ -0,0 +1,459 @@
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200112L
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <time.h>
+#endif
+
+#include "perfcount.h"
+#include "stats.h"
+
+#if defined(_MSC_VER)
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+/* Counters of one thread, kept after the thread ends until the report */
+typedef struct stats_block
+{
+    stats_counters total;
+    stats_counters* entries;
+    struct stats_block* next;
+} stats_block;
+
+static int enabled;
+static size_t entry_count;
+static const char** entry_names;
+static stats_block* blocks;
+static THREAD_LOCAL stats_block* current;
+
+/* Phases run on the main thread */
+static int phase = STATS_NONE;
+static uint64_t phase_wall, phase_cpu;
+static uint64_t phase_totals[STATS_PHASES][2];
+static const char* const phase_names[STATS_PHASES] = { "load", "compile", "scan", "extract", "print" };
+
+/* Hardware counters run during scan phases only */
+static int perf;
+
+/* Latencies of batch files */
+static uint64_t* samples;
+static size_t sample_count, sample_capacity;
+
+#ifdef _WIN32
+static CRITICAL_SECTION lock;
+#define LOCK() EnterCriticalSection(&lock)
+#define UNLOCK() LeaveCriticalSection(&lock)
+#else
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+#define LOCK() pthread_mutex_lock(&lock)
+#define UNLOCK() pthread_mutex_unlock(&lock)
+#endif
+
+uint64_t stats_clock(void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER counter, frequency;
+
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    return (uint64_t) (counter.QuadPart / frequency.QuadPart) * 1000000000 +
+           (uint64_t) (counter.QuadPart % frequency.QuadPart) * 1000000000 / frequency.QuadPart;
+#else
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000 + (uint64_t) now.tv_nsec;
+#endif
+}
+
+/* CPU time of all threads of the process */
+static uint64_t process_time(void)
+{
+#ifdef _WIN32
+    FILETIME creation, exit, kernel, user;
+
+    if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user))
+        return 0;
+    return ((((uint64_t) kernel.dwHighDateTime << 32) | kernel.dwLowDateTime) +
+            (((uint64_t) user.dwHighDateTime << 32) | user.dwLowDateTime)) * 100;
+#else
+    struct timespec now;
+
+    if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now))
+        return 0;
+    return (uint64_t) now.tv_sec * 1000000000 + (uint64_t) now.tv_nsec;
+#endif
+}
+
+uint8_t stats_start(size_t entries)
+{
+#ifdef _WIN32
+    InitializeCriticalSection(&lock);
+#endif
+    entry_names = (const char**) calloc(entries + 1, sizeof(const char*));
+    if (!entry_names)
+        return STATS_ERR_OUT_OF_MEMORY;
+    entry_count = entries;
+    enabled = 1;
+    return STATS_SUCCESS;
+}
+
+void stats_name(size_t entry, const char* name)
+{
+    if (enabled && entry < entry_count)
+        entry_names[entry] = name;
+}
+
+stats_counters* stats_thread(void)
+{
+    stats_block* block;
+
+    if (!enabled)
+        return NULL;
+    if (current)
+        return &current->total;
+
+    /* First search of the thread, a thread without memory goes uncounted */
+    block = (stats_block*) calloc(1, sizeof(stats_block));
+    if (!block)
+        return NULL;
+    block->entries = (stats_counters*) calloc(entry_count + 1, sizeof(stats_counters));
+    if (!block->entries)
+    {
+        free(block);
+        return NULL;
+    }
+    LOCK();
+    block->next = blocks;
+    blocks = block;
+    UNLOCK();
+    current = block;
+    return &block->total;
+}
+
+void stats_begin(stats_mark* mark)
+{
+    mark->thread = stats_thread();
+    if (!mark->thread)
+        return;
+    mark->start = *mark->thread;
+    mark->time = stats_clock();
+}
+
+void stats_end(const stats_mark* mark, size_t entry)
+{
+    stats_counters* counters;
+
+    if (!mark->thread || entry >= entry_count)
+        return;
+    counters = &current->entries[entry];
+    counters->calls += mark->thread->calls - mark->start.calls;
+    counters->bytes += mark->thread->bytes - mark->start.bytes;
+    counters->candidates += mark->thread->candidates - mark->start.candidates;
+    counters->matches += mark->thread->matches - mark->start.matches;
+    counters->nanoseconds += stats_clock() - mark->time;
+}
+
+void stats_add(size_t entry, uint64_t calls, uint64_t bytes, uint64_t candidates, uint64_t matches)
+{
+    stats_counters* counters;
+
+    if (!stats_thread() || entry >= entry_count)
+        return;
+    counters = &current->entries[entry];
+    counters->calls += calls;
+    counters->bytes += bytes;
+    counters->candidates += candidates;
+    counters->matches += matches;
+}
+
+void stats_phase(int next)
+{
+    uint64_t wall, cpu;
+
+    if (!enabled)
+        return;
+    wall = stats_clock();
+    cpu = process_time();
+    if (phase < STATS_PHASES)
+    {
+        phase_totals[phase][0] += wall - phase_wall;
+        phase_totals[phase][1] += cpu - phase_cpu;
+    }
+    if (perf && phase == STATS_SCAN && next != STATS_SCAN)
+        perfcount_pause();
+    else if (perf && phase != STATS_SCAN && next == STATS_SCAN)
+        perfcount_resume();
+    phase = next;
+    phase_wall = wall;
+    phase_cpu = cpu;
+}
+
+uint8_t stats_perf(void)
+{
+    if (!enabled)
+        return STATS_SUCCESS;
+    if (perfcount_open())
+        return PERFCOUNT_ERR_UNAVAILABLE;
+    perf = 1;
+    return STATS_SUCCESS;
+}
+
+void stats_sample(uint64_t nanoseconds)
+{
+    uint64_t* grown;
+    size_t capacity;
+
+    if (!enabled)
+        return;
+    LOCK();
+    if (sample_count == sample_capacity)
+    {
+        capacity = sample_capacity ? 2 * sample_capacity : 256;
+        grown = (uint64_t*) realloc(samples, capacity * sizeof(uint64_t));
+        if (grown)
+        {
+            samples = grown;
+            sample_capacity = capacity;
+        }
+    }
+    if (sample_count < sample_capacity)
+        samples[sample_count++] = nanoseconds;
+    UNLOCK();
+}
+
+static int compare_samples(const void* first, const void* second)
+{
+    uint64_t a = *(const uint64_t*) first;
+    uint64_t b = *(const uint64_t*) second;
+
+    return a < b ? -1 : a > b;
+}
+
+/* Sample below which percent of samples are, nearest rank */
+static double percentile(unsigned percent)
+{
+    size_t rank = (sample_count * percent + 99) / 100;
+
+    return (double) samples[rank ? rank - 1 : 0] / 1e6;
+}
+
+/* Entry of the report */
+typedef struct
+{
+    stats_counters counters;
+    const char* name;
+} stats_row;
+
+/* Most expensive entries first */
+static int compare_rows(const void* first, const void* second)
+{
+    const stats_counters* a = &((const stats_row*) first)->counters;
+    const stats_counters* b = &((const stats_row*) second)->counters;
+
+    if (a->nanoseconds != b->nanoseconds)
+        return a->nanoseconds > b->nanoseconds ? -1 : 1;
+    if (a->bytes != b->bytes)
+        return a->bytes > b->bytes ? -1 : 1;
+    return a->matches > b->matches ? -1 : a->matches < b->matches;
+}
+
+static void add_counters(stats_counters* sum, const stats_counters* counters)
+{
+    sum->calls += counters->calls;
+    sum->bytes += counters->bytes;
+    sum->candidates += counters->candidates;
+    sum->matches += counters->matches;
+    sum->nanoseconds += counters->nanoseconds;
+}
+
+static void write_json_string(FILE* out, const char* string)
+{
+    fputc('"', out);
+    for (; *string; string++)
+    {
+        if (*string == '"' || *string == '\\')
+            fprintf(out, "\\%c", *string);
+        else if ((unsigned char) *string < 0x20)
+            fprintf(out, "\\u%04X", (unsigned) (unsigned char) *string);
+        else
+            fputc(*string, out);
+    }
+    fputc('"', out);
+}
+
+/* Hardware event per byte scanned */
+static double per_byte(const perfcount_values* values, size_t counter, uint64_t bytes)
+{
+    return bytes ? (double) values->values[counter] / (double) bytes : 0.0;
+}
+
+static void print_text(FILE* out, const stats_counters* total, const stats_row* rows, size_t count,
+                       const perfcount_values* values)
+{
+    size_t i;
+
+    fprintf(out, "Statistics\n");
+    fprintf(out, "  Phase      Wall ms     CPU ms\n");
+    for (i = 0; i < STATS_PHASES; i++)
+        fprintf(out, "  %-8s %9.3f  %9.3f\n", phase_names[i], phase_totals[i][0] / 1e6, phase_totals[i][1] / 1e6);
+    fprintf(out, "  Searches %llu, bytes %llu, candidates %llu, matches %llu\n",
+            (unsigned long long) total->calls, (unsigned long long) total->bytes,
+            (unsigned long long) total->candidates, (unsigned long long) total->matches);
+    if (sample_count)
+        fprintf(out, "  Files %lu, latency ms p50 %.3f, p95 %.3f, p99 %.3f, max %.3f\n", (unsigned long) sample_count,
+                percentile(50), percentile(95), percentile(99), percentile(100));
+    if (values)
+    {
+        fprintf(out, "  %-24s %16s %12s\n", "Counter of scan", "Count", "Per byte");
+        for (i = 0; i < PERFCOUNT_COUNT; i++)
+        {
+            if (values->available[i])
+                fprintf(out, "  %-24s %16llu %12.6f\n", perfcount_name(i), (unsigned long long) values->values[i],
+                        per_byte(values, i, total->bytes));
+            else
+                fprintf(out, "  %-24s %16s %12s\n", perfcount_name(i), "n/a", "n/a");
+        }
+        if (values->available[PERFCOUNT_CYCLES] && values->available[PERFCOUNT_INSTRUCTIONS] &&
+            values->values[PERFCOUNT_CYCLES])
+            fprintf(out, "  Instructions per cycle %.3f\n",
+                    (double) values->values[PERFCOUNT_INSTRUCTIONS] / (double) values->values[PERFCOUNT_CYCLES]);
+    }
+    if (!count)
+        return;
+
+    fprintf(out, "  %-24s %10s %12s %10s %8s %9s\n", "Entry", "Calls", "Bytes", "Candidates", "Matches", "Time ms");
+    for (i = 0; i < count; i++)
+        fprintf(out, "  %-24s %10llu %12llu %10llu %8llu %9.3f\n", rows[i].name,
+                (unsigned long long) rows[i].counters.calls, (unsigned long long) rows[i].counters.bytes,
+                (unsigned long long) rows[i].counters.candidates, (unsigned long long) rows[i].counters.matches,
+                rows[i].counters.nanoseconds / 1e6);
+}
+
+static void print_json(FILE* out, const stats_counters* total, const stats_row* rows, size_t count,
+                       const perfcount_values* values)
+{
+    size_t i;
+    int first = 1;
+
+    fprintf(out, "{\n  \"phases\": {");
+    for (i = 0; i < STATS_PHASES; i++)
+        fprintf(out, "%s\n    \"%s\": {\"wall_ms\": %.3f, \"cpu_ms\": %.3f}", i ? "," : "", phase_names[i],
+                phase_totals[i][0] / 1e6, phase_totals[i][1] / 1e6);
+    fprintf(out, "\n  },\n  \"searches\": {\"calls\": %llu, \"bytes\": %llu, \"candidates\": %llu, \"matches\": %llu},\n",
+            (unsigned long long) total->calls, (unsigned long long) total->bytes,
+            (unsigned long long) total->candidates, (unsigned long long) total->matches);
+    if (sample_count)
+        fprintf(out, "  \"files\": {\"count\": %lu, \"p50_ms\": %.3f, \"p95_ms\": %.3f, \"p99_ms\": %.3f, \"max_ms\": %.3f},\n",
+                (unsigned long) sample_count, percentile(50), percentile(95), percentile(99), percentile(100));
+    if (values)
+    {
+        /* Counters that aren't available are left out */
+        fprintf(out, "  \"counters\": {");
+        for (i = 0; i < PERFCOUNT_COUNT; i++)
+        {
+            if (!values->available[i])
+                continue;
+            fprintf(out, "%s\n    \"%s\": {\"count\": %llu, \"per_byte\": %.6f}", first ? "" : ",", perfcount_name(i),
+                    (unsigned long long) values->values[i], per_byte(values, i, total->bytes));
+            first = 0;
+        }
+        fprintf(out, "%s},\n", first ? "" : "\n  ");
+    }
+    fprintf(out, "  \"entries\": [");
+    for (i = 0; i < count; i++)
+    {
+        fprintf(out, "%s\n    {\"name\": ", i ? "," : "");
+        write_json_string(out, rows[i].name);
+        fprintf(out, ", \"calls\": %llu, \"bytes\": %llu, \"candidates\": %llu, \"matches\": %llu, \"time_ms\": %.3f}",
+                (unsigned long long) rows[i].counters.calls, (unsigned long long) rows[i].counters.bytes,
+                (unsigned long long) rows[i].counters.candidates, (unsigned long long) rows[i].counters.matches,
+                rows[i].counters.nanoseconds / 1e6);
+    }
+    fprintf(out, "%s]\n}\n", count ? "\n  " : "");
+}
+
+uint8_t stats_report(FILE* out, const char* filename)
+{
+    stats_counters total;
+    stats_row* rows;
+    perfcount_values values;
+    stats_block* block;
+    stats_block* next;
+    FILE* file = NULL;
+    size_t i, count = 0;
+    uint8_t result = STATS_SUCCESS;
+
+    if (!enabled)
+        return STATS_SUCCESS;
+    stats_phase(STATS_NONE);
+    if (perf)
+        perfcount_read(&values);
+
+    rows = (stats_row*) calloc(entry_count + 1, sizeof(stats_row));
+    if (!rows)
+        result = STATS_ERR_OUT_OF_MEMORY;
+    else if (filename && !(file = fopen(filename, "w")))
+        result = STATS_ERR_FILE_OPEN;
+
+    if (!result)
+    {
+        /* Threads are merged, entries that did nothing are left out */
+        memset(&total, 0, sizeof(total));
+        for (block = blocks; block; block = block->next)
+        {
+            add_counters(&total, &block->total);
+            for (i = 0; i < entry_count; i++)
+                add_counters(&rows[i].counters, &block->entries[i]);
+        }
+        for (i = 0; i < entry_count; i++)
+        {
+            if (!rows[i].counters.calls && !rows[i].counters.bytes && !rows[i].counters.candidates && !rows[i].counters.matches)
+                continue;
+            rows[count].counters = rows[i].counters;
+            rows[count].name = entry_names[i] ? entry_names[i] : "?";
+            count++;
+        }
+        qsort(rows, count, sizeof(stats_row), compare_rows);
+        if (sample_count)
+            qsort(samples, sample_count, sizeof(uint64_t), compare_samples);
+
+        if (file)
+        {
+            print_json(file, &total, rows, count, perf ? &values : NULL);
+            fclose(file);
+        }
+        else
+            print_text(out, &total, rows, count, perf ? &values : NULL);
+    }
+
+    /* Statistics are off after the report */
+    enabled = 0;
+    if (perf)
+        perfcount_close();
+    perf = 0;
+    for (block = blocks; block; block = next)
+    {
+        next = block->next;
+        free(block->entries);
+        free(block);
+    }
+    blocks = NULL;
+    current = NULL;
+    free(rows);
+    free(entry_names);
+    entry_names = NULL;
+    free(samples);
+    samples = NULL;
+    sample_count = sample_capacity = 0;
+    return result;
+}
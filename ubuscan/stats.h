@@ -0,0 +1,79 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Return codes, same values as ERR_* codes of the tools */
+#define STATS_SUCCESS           0
+#define STATS_ERR_FILE_OPEN     2
+#define STATS_ERR_OUT_OF_MEMORY 5
+
+/* Phases of a run, time of each is summed over all its intervals */
+#define STATS_LOAD    0
+#define STATS_COMPILE 1
+#define STATS_SCAN    2
+#define STATS_EXTRACT 3
+#define STATS_PRINT   4
+#define STATS_PHASES  5
+#define STATS_NONE    STATS_PHASES
+
+/* Work of search engines, kept for every thread and for every entry
+*  (signature or pattern) while statistics are on */
+typedef struct
+{
+    uint64_t calls;        /* Searches and counts made */
+    uint64_t bytes;        /* Bytes given to them */
+    uint64_t candidates;   /* Positions that passed the byte filter and were compared in full,
+                            *  every position for popcount kernels and the automaton */
+    uint64_t matches;
+    uint64_t nanoseconds;  /* Wall time, entries only */
+} stats_counters;
+
+/* Work charged to an entry, from stats_begin to stats_end on one thread */
+typedef struct
+{
+    stats_counters* thread;  /* NULL while statistics are off */
+    stats_counters  start;
+    uint64_t time;
+} stats_mark;
+
+/* Turns statistics on with entries named later by stats_name,
+*  must be called before any other thread searches */
+uint8_t stats_start(size_t entries);
+
+/* Name is not copied and must stay valid until the report */
+void stats_name(size_t entry, const char* name);
+
+/* Counters of calling thread, NULL while statistics are off */
+stats_counters* stats_thread(void);
+
+/* Charges searches of calling thread between the calls to entry */
+void stats_begin(stats_mark* mark);
+void stats_end(const stats_mark* mark, size_t entry);
+
+/* Charges work done without search engines to entry */
+void stats_add(size_t entry, uint64_t calls, uint64_t bytes, uint64_t candidates, uint64_t matches);
+
+/* Ends the current phase and starts phase, STATS_NONE only ends it.
+*  Phases are switched by the main thread, CPU time of all threads is counted */
+void stats_phase(int phase);
+
+/* Counts hardware events of scan phases too and reports them per byte scanned,
+*  must be called after stats_start and before other threads are started.
+*  Returns PERFCOUNT_ERR_UNAVAILABLE when no counter can be opened,
+*  statistics are kept without them then */
+uint8_t stats_perf(void);
+
+/* Records time taken by one file of a batch */
+void stats_sample(uint64_t nanoseconds);
+
+/* Monotonic time in nanoseconds */
+uint64_t stats_clock(void);
+
+/* Prints statistics to out, or writes them as JSON when filename is not NULL,
+*  then turns statistics off */
+uint8_t stats_report(FILE* out, const char* filename);
+
+#endif
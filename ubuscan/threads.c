@@ -0,0 +1,201 @@
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#include "threads.h"
+
+/* State shared by workers of one run_parallel call */
+typedef struct
+{
+    parallel_task task;
+    parallel_task finish;
+    void*  context;
+    size_t count;
+    size_t next;
+    uint8_t* done;      /* Tasks done but not finished yet */
+    size_t finished;    /* Indices before it are finished */
+    int    finishing;   /* Some worker is calling finish */
+#ifdef _WIN32
+    CRITICAL_SECTION lock;
+#else
+    pthread_mutex_t lock;
+#endif
+} parallel_state;
+
+static void lock_state(parallel_state* state)
+{
+#ifdef _WIN32
+    EnterCriticalSection(&state->lock);
+#else
+    pthread_mutex_lock(&state->lock);
+#endif
+}
+
+static void unlock_state(parallel_state* state)
+{
+#ifdef _WIN32
+    LeaveCriticalSection(&state->lock);
+#else
+    pthread_mutex_unlock(&state->lock);
+#endif
+}
+
+static int take_index(parallel_state* state, size_t* index)
+{
+    int taken;
+
+    lock_state(state);
+    taken = state->next < state->count;
+    if (taken)
+        *index = state->next++;
+    unlock_state(state);
+    return taken;
+}
+
+/* Marks task done and finishes every index that is ready, unless another worker
+*  is already doing it, then that worker finishes this index too */
+static void finish_index(parallel_state* state, size_t index)
+{
+    size_t ready;
+
+    lock_state(state);
+    state->done[index] = 1;
+    if (state->finishing)
+    {
+        unlock_state(state);
+        return;
+    }
+    state->finishing = 1;
+    while (state->finished < state->count && state->done[state->finished])
+    {
+        ready = state->finished++;
+        unlock_state(state);
+        state->finish(state->context, ready);
+        lock_state(state);
+    }
+    state->finishing = 0;
+    unlock_state(state);
+}
+
+#ifdef _WIN32
+static DWORD WINAPI parallel_worker(LPVOID argument)
+#else
+static void* parallel_worker(void* argument)
+#endif
+{
+    parallel_state* state = (parallel_state*) argument;
+    size_t index;
+
+    while (take_index(state, &index))
+    {
+        state->task(state->context, index);
+        if (state->finish)
+            finish_index(state, index);
+    }
+
+    return 0;
+}
+
+uint8_t run_parallel(size_t count, unsigned threads, parallel_task task, void* context)
+{
+    return run_parallel_ordered(count, threads, task, NULL, context);
+}
+
+uint8_t run_parallel_ordered(size_t count, unsigned threads, parallel_task task, parallel_task finish, void* context)
+{
+    parallel_state state;
+    unsigned started;
+    unsigned i;
+#ifdef _WIN32
+    HANDLE* workers;
+#else
+    pthread_t* workers;
+#endif
+
+    if (threads > count)
+        threads = (unsigned) count;
+
+    /* Running in the calling thread when there is nothing to share */
+    if (threads <= 1)
+    {
+        for (i = 0; i < count; i++)
+        {
+            task(context, i);
+            if (finish)
+                finish(context, i);
+        }
+        return 0;
+    }
+
+    memset(&state, 0, sizeof(state));
+    workers = malloc(threads * sizeof(*workers));
+    state.done = finish ? (uint8_t*) calloc(count, 1) : NULL;
+    if (!workers || (finish && !state.done))
+    {
+        free(workers);
+        free(state.done);
+        return 1;
+    }
+
+    state.task = task;
+    state.finish = finish;
+    state.context = context;
+    state.count = count;
+#ifdef _WIN32
+    InitializeCriticalSection(&state.lock);
+#else
+    pthread_mutex_init(&state.lock, NULL);
+#endif
+
+    /* Calling thread works too, so one thread less is started */
+    for (started = 0; started < threads - 1; started++)
+    {
+#ifdef _WIN32
+        workers[started] = CreateThread(NULL, 0, parallel_worker, &state, 0, NULL);
+        if (!workers[started])
+            break;
+#else
+        if (pthread_create(&workers[started], NULL, parallel_worker, &state))
+            break;
+#endif
+    }
+
+    parallel_worker(&state);
+
+    for (i = 0; i < started; i++)
+    {
+#ifdef _WIN32
+        WaitForSingleObject(workers[i], INFINITE);
+        CloseHandle(workers[i]);
+#else
+        pthread_join(workers[i], NULL);
+#endif
+    }
+
+#ifdef _WIN32
+    DeleteCriticalSection(&state.lock);
+#else
+    pthread_mutex_destroy(&state.lock);
+#endif
+    free(workers);
+    free(state.done);
+    return 0;
+}
+
+unsigned cpu_count(void)
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors ? (unsigned) info.dwNumberOfProcessors : 1;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (unsigned) count : 1;
+#endif
+}
@@ -0,0 +1,23 @@
+#ifndef THREADS_H
+#define THREADS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Task run for every index, must be safe to run concurrently with itself */
+typedef void (*parallel_task)(void* context, size_t index);
+
+/* Runs task for indices 0 to count-1 on up to threads workers,
+*  workers take the next free index when they finish the previous one.
+*  Returns 0 on success or 1 if threads can't be started */
+uint8_t run_parallel(size_t count, unsigned threads, parallel_task task, void* context);
+
+/* Same as run_parallel, and finish is called for every index in order 0 to count-1
+*  as soon as tasks of it and all indices before it are done. Calls of finish never
+*  overlap, so results can be printed from it while later tasks still run */
+uint8_t run_parallel_ordered(size_t count, unsigned threads, parallel_task task, parallel_task finish, void* context);
+
+/* Number of online CPUs, at least 1 */
+unsigned cpu_count(void);
+
+#endif
@@ -0,0 +1,197 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#include "stats.h"
+#include "trace.h"
+
+#if defined(_MSC_VER)
+#define THREAD_LOCAL __declspec(thread)
+#define vsnprintf _vsnprintf
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+/* Events are formatted into a buffer of their thread and written out together */
+#define TRACE_BUFFER_SIZE (64 * 1024)
+#define TRACE_EVENT_SIZE  256 /* Event without its name, categories are short */
+
+/* Events of one thread, kept after the thread ends until the trace is written */
+typedef struct trace_block
+{
+    char*    text;      /* Events, each one preceded by a comma */
+    size_t   length;
+    size_t   capacity;
+    unsigned thread;    /* Numbered in order of first event, main thread is 1 */
+    uint8_t  failed;    /* Some events were lost for lack of memory */
+    struct trace_block* next;
+} trace_block;
+
+static int enabled;
+static FILE* file;
+static uint64_t origin;
+static unsigned thread_count;
+static trace_block* blocks;
+static THREAD_LOCAL trace_block* current;
+
+#ifdef _WIN32
+static CRITICAL_SECTION lock;
+#define LOCK() EnterCriticalSection(&lock)
+#define UNLOCK() LeaveCriticalSection(&lock)
+#else
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+#define LOCK() pthread_mutex_lock(&lock)
+#define UNLOCK() pthread_mutex_unlock(&lock)
+#endif
+
+/* Block of calling thread, NULL while tracing is off or without memory */
+static trace_block* thread_block(void)
+{
+    trace_block* block;
+
+    if (!enabled)
+        return NULL;
+    if (current)
+        return current;
+
+    block = (trace_block*) calloc(1, sizeof(trace_block));
+    if (!block)
+        return NULL;
+    LOCK();
+    block->thread = ++thread_count;
+    block->next = blocks;
+    blocks = block;
+    UNLOCK();
+    current = block;
+    return block;
+}
+
+/* Copies string to JSON string body, quotes, backslashes and control characters are escaped */
+static void escape_string(char* out, const char* string)
+{
+    for (; *string; string++)
+    {
+        if (*string == '"' || *string == '\\')
+        {
+            *out++ = '\\';
+            *out++ = *string;
+        }
+        else if ((unsigned char) *string < 0x20)
+            out += sprintf(out, "\\u%04X", (unsigned char) *string);
+        else
+            *out++ = *string;
+    }
+    *out = 0;
+}
+
+uint8_t trace_start(const char* filename)
+{
+#ifdef _WIN32
+    InitializeCriticalSection(&lock);
+#endif
+    file = fopen(filename, "w");
+    if (!file)
+        return TRACE_ERR_FILE_OPEN;
+    origin = stats_clock();
+    enabled = 1;
+    thread_block();
+    return TRACE_SUCCESS;
+}
+
+void trace_begin(trace_span* span)
+{
+    span->start = enabled ? stats_clock() : 0;
+}
+
+void trace_end(const trace_span* span, const char* category, const char* format, ...)
+{
+    trace_block* block;
+    va_list args;
+    char name[TRACE_NAME_SIZE];
+    char escaped[TRACE_NAME_SIZE * 6];
+    char* grown;
+    uint64_t end;
+    size_t capacity;
+
+    if (!span->start || !(block = thread_block()))
+        return;
+    end = stats_clock();
+
+    va_start(args, format);
+    vsnprintf(name, sizeof(name), format, args);
+    va_end(args);
+    name[sizeof(name) - 1] = 0;
+    escape_string(escaped, name);
+
+    if (block->capacity - block->length < sizeof(escaped) + TRACE_EVENT_SIZE)
+    {
+        capacity = block->capacity ? 2 * block->capacity : TRACE_BUFFER_SIZE;
+        grown = (char*) realloc(block->text, capacity);
+        if (!grown)
+        {
+            block->failed = 1;
+            return;
+        }
+        block->text = grown;
+        block->capacity = capacity;
+    }
+
+    /* Complete event, times in microseconds from the start of the trace */
+    block->length += (size_t) sprintf(block->text + block->length,
+        ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u}",
+        escaped, category, (double) (span->start - origin) / 1000.0, (double) (end - span->start) / 1000.0,
+        block->thread);
+}
+
+uint8_t trace_finish(void)
+{
+    trace_block* block;
+    trace_block* next;
+    uint8_t result = TRACE_SUCCESS;
+
+    if (!enabled)
+        return TRACE_SUCCESS;
+
+    /* Metadata goes first, so every event that follows starts with a comma */
+    fprintf(file, "{\"traceEvents\":[\n"
+                  "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"ubuscan\"}}");
+    for (block = blocks; block; block = block->next)
+    {
+        if (block->thread == 1)
+            fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"main\"}}");
+        else
+            fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"thread %u\"}}",
+                    block->thread, block->thread);
+        if (block->failed)
+            result = TRACE_ERR_OUT_OF_MEMORY;
+    }
+    for (block = blocks; block; block = block->next)
+        if (block->length && fwrite(block->text, 1, block->length, file) != block->length)
+            result = TRACE_ERR_FILE_WRITE;
+    fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+    if (ferror(file))
+        result = TRACE_ERR_FILE_WRITE;
+    if (fclose(file))
+        result = TRACE_ERR_FILE_WRITE;
+
+    /* Tracing is off after the file is written */
+    enabled = 0;
+    file = NULL;
+    for (block = blocks; block; block = next)
+    {
+        next = block->next;
+        free(block->text);
+        free(block);
+    }
+    blocks = NULL;
+    current = NULL;
+    thread_count = 0;
+    return result;
+}
@@ -0,0 +1,35 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+/* Return codes, same values as ERR_* codes of the tools where they overlap */
+#define TRACE_SUCCESS           0
+#define TRACE_ERR_FILE_OPEN     2
+#define TRACE_ERR_FILE_WRITE    3 /* Trace file was opened but couldn't be written */
+#define TRACE_ERR_OUT_OF_MEMORY 5
+
+/* Longest span name written, longer names are cut */
+#define TRACE_NAME_SIZE 256
+
+/* Work done on one thread from trace_begin to trace_end */
+typedef struct
+{
+    uint64_t start;  /* Zero while tracing is off */
+} trace_span;
+
+/* Creates trace file and turns tracing on, the calling thread is named "main".
+*  Must be called before any other thread traces */
+uint8_t trace_start(const char* filename);
+
+void trace_begin(trace_span* span);
+
+/* Records span as a complete event of category with name formatted by printf rules,
+*  the name is formatted only while tracing is on */
+void trace_end(const trace_span* span, const char* category, const char* format, ...);
+
+/* Writes events of all threads in Chrome trace event format, closes the file
+*  and turns tracing off */
+uint8_t trace_finish(void);
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef UBUSCAN_H
+#define UBUSCAN_H
+
+/* Scanning library shared by hexfind, findver and drvver,
+*  programs embedding it need only this header and the ubuscan library */
+#include "acmatch.h"
+#include "decompress.h"
+#include "drivers.h"
+#include "extract.h"
+#include "filelist.h"
+#include "firmware.h"
+#include "image.h"
+#include "microcode.h"
+#include "ngram.h"
+#include "optionrom.h"
+#include "pattern.h"
+#include "pe.h"
+#include "perfcount.h"
+#include "search.h"
+#include "stats.h"
+#include "threads.h"
+#include "trace.h"
+
+#endif
@@ -0,0 +1,770 @@
+#if !defined(_WIN32) && !defined(_FILE_OFFSET_BITS)
+#define _FILE_OFFSET_BITS 64
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+#include "drivers.h"
+#include "extract.h"
+#include "image.h"
+#include "pattern.h"
+#include "search.h"
+
+/* Return codes */
+#define ERR_SUCCESS           0
+#define ERR_NOT_FOUND         1
+#define ERR_FILE_OPEN         2
+#define ERR_FILE_READ         3
+#define ERR_INVALID_PARAMETER 4
+#define ERR_OUT_OF_MEMORY     5
+
+/* Megabytes of mapped images kept by default */
+#define DEFAULT_MEMORY_CAP 1024
+
+/* Compiled patterns kept, least recently used ones are dropped first */
+#define PATTERN_CACHE_SIZE 4096
+#define PATTERN_BUCKETS    1024
+
+/* Limits of one request line */
+#define MAX_FIELDS  256
+#define MAX_REQUEST (64 * 1024)
+
+/* Clients served at once on the socket */
+#define MAX_CLIENTS 64
+
+/* Mapped image and identity of the file it was loaded from,
+*  file replaced or rewritten since then is loaded again */
+typedef struct cached_image
+{
+    char*    name;
+    image_t  image;
+    uint64_t file_size;
+    int64_t  mtime;
+    int64_t  ctime;
+    uint64_t inode;
+    unsigned long last_used;
+    struct cached_image* next;
+} cached_image;
+
+/* Compiled pattern keyed by its hex text */
+typedef struct cached_pattern
+{
+    char* text;
+    compiled_pattern* compiled;
+    unsigned long last_used;
+    struct cached_pattern* next;
+} cached_pattern;
+
+/* State kept between requests */
+typedef struct
+{
+    cached_image* images;
+    size_t image_bytes;
+    size_t memory_cap;
+    cached_pattern* patterns[PATTERN_BUCKETS];
+    size_t pattern_count;
+    driver_database* drivers;    /* Signatures of drvver requests */
+    unsigned long clock;         /* Ticks once per request */
+    unsigned long requests;
+    unsigned long image_hits;
+    unsigned long image_loads;
+    unsigned long image_evictions;
+    unsigned long pattern_hits;
+    unsigned long pattern_compiles;
+} server_cache;
+
+static volatile sig_atomic_t stopping = 0;
+
+static void stop_server(int signal_number)
+{
+    (void) signal_number;
+    stopping = 1;
+}
+
+static void drop_image(server_cache* cache, cached_image* entry)
+{
+    cached_image** link;
+
+    for (link = &cache->images; *link != entry; link = &(*link)->next)
+        ;
+    *link = entry->next;
+    cache->image_bytes -= entry->image.size;
+    free_image(&entry->image);
+    free(entry->name);
+    free(entry);
+}
+
+/* Returns mapped image of file, loading it if it is not cached or changed since.
+*  Images not used by the current request are evicted, least recently used
+*  first, until the new one fits under the memory cap */
+static uint8_t open_image(server_cache* cache, const char* name, cached_image** found)
+{
+    struct stat info;
+    cached_image* entry;
+    cached_image* oldest;
+    uint8_t result;
+
+    /* Standard input carries requests, not images */
+    if (!strcmp(name, "-") || stat(name, &info))
+        return ERR_FILE_OPEN;
+
+    for (entry = cache->images; entry; entry = entry->next)
+        if (!strcmp(entry->name, name))
+            break;
+    if (entry)
+    {
+        if (entry->file_size == (uint64_t) info.st_size && entry->mtime == (int64_t) info.st_mtime &&
+            entry->ctime == (int64_t) info.st_ctime && entry->inode == (uint64_t) info.st_ino)
+        {
+            cache->image_hits++;
+            entry->last_used = cache->clock;
+            *found = entry;
+            return ERR_SUCCESS;
+        }
+        drop_image(cache, entry);
+    }
+
+    while (cache->images && cache->image_bytes + (size_t) info.st_size > cache->memory_cap)
+    {
+        oldest = cache->images;
+        for (entry = cache->images; entry; entry = entry->next)
+            if (entry->last_used < oldest->last_used)
+                oldest = entry;
+        drop_image(cache, oldest);
+        cache->image_evictions++;
+    }
+
+    entry = (cached_image*) calloc(1, sizeof(cached_image));
+    if (!entry)
+        return ERR_OUT_OF_MEMORY;
+    entry->name = (char*) malloc(strlen(name) + 1);
+    if (!entry->name)
+    {
+        free(entry);
+        return ERR_OUT_OF_MEMORY;
+    }
+    strcpy(entry->name, name);
+
+    result = load_image(name, &entry->image, IMAGE_READ_ONLY);
+    if (result)
+    {
+        free(entry->name);
+        free(entry);
+        return result;
+    }
+
+    entry->file_size = (uint64_t) info.st_size;
+    entry->mtime = (int64_t) info.st_mtime;
+    entry->ctime = (int64_t) info.st_ctime;
+    entry->inode = (uint64_t) info.st_ino;
+    entry->last_used = cache->clock;
+    entry->next = cache->images;
+    cache->images = entry;
+    cache->image_bytes += entry->image.size;
+    cache->image_loads++;
+    *found = entry;
+    return ERR_SUCCESS;
+}
+
+static size_t pattern_bucket(const char* text)
+{
+    uint32_t hash = 0x811C9DC5u;
+
+    while (*text)
+        hash = (hash ^ (uint8_t) *text++) * 0x01000193u;
+    return hash % PATTERN_BUCKETS;
+}
+
+/* Drops least recently used pattern not used by the current request,
+*  so patterns of a request stay valid until it is answered */
+static void evict_pattern(server_cache* cache)
+{
+    cached_pattern** oldest = NULL;
+    cached_pattern** link;
+    cached_pattern* entry;
+    size_t i;
+
+    for (i = 0; i < PATTERN_BUCKETS; i++)
+        for (link = &cache->patterns[i]; *link; link = &(*link)->next)
+            if ((*link)->last_used != cache->clock && (!oldest || (*link)->last_used < (*oldest)->last_used))
+                oldest = link;
+    if (!oldest)
+        return;
+
+    entry = *oldest;
+    *oldest = entry->next;
+    free_compiled_pattern(entry->compiled);
+    free(entry->text);
+    free(entry);
+    cache->pattern_count--;
+}
+
+/* Returns compiled pattern for hex text, compiling it on first use */
+static compiled_pattern* get_pattern(server_cache* cache, const char* text, uint8_t* result)
+{
+    cached_pattern* entry;
+    uint8_t* pattern;
+    uint8_t* mask;
+    size_t length;
+    size_t bucket = pattern_bucket(text);
+
+    for (entry = cache->patterns[bucket]; entry; entry = entry->next)
+    {
+        if (!strcmp(entry->text, text))
+        {
+            cache->pattern_hits++;
+            entry->last_used = cache->clock;
+            return entry->compiled;
+        }
+    }
+
+    if (read_pattern(text, &pattern, &mask, &length) || !length)
+    {
+        *result = ERR_INVALID_PARAMETER;
+        return NULL;
+    }
+
+    *result = ERR_OUT_OF_MEMORY;
+    entry = (cached_pattern*) calloc(1, sizeof(cached_pattern));
+    if (entry)
+    {
+        entry->text = (char*) malloc(strlen(text) + 1);
+        entry->compiled = compile_pattern(pattern, mask, length);
+    }
+    free(pattern);
+    free(mask);
+    if (!entry || !entry->text || !entry->compiled)
+    {
+        if (entry)
+        {
+            free_compiled_pattern(entry->compiled);
+            free(entry->text);
+            free(entry);
+        }
+        return NULL;
+    }
+
+    if (cache->pattern_count >= PATTERN_CACHE_SIZE)
+        evict_pattern(cache);
+    strcpy(entry->text, text);
+    entry->last_used = cache->clock;
+    entry->next = cache->patterns[bucket];
+    cache->patterns[bucket] = entry;
+    cache->pattern_count++;
+    cache->pattern_compiles++;
+    return entry->compiled;
+}
+
+static void print_image_error(FILE* out, uint8_t result)
+{
+    if (result == ERR_FILE_OPEN)
+        fprintf(out, "File can't be opened.\n");
+    else if (result == ERR_OUT_OF_MEMORY)
+        fprintf(out, "Can't allocate memory for file contents.\n");
+    else if (result)
+        fprintf(out, "Can't read file.\n");
+}
+
+/* hexfind PATTERN [PATTERN...] FILENAME */
+static uint8_t serve_hexfind(server_cache* cache, int argc, char* argv[], FILE* out)
+{
+    compiled_pattern* compiled[MAX_FIELDS];
+    cached_image* entry;
+    unsigned long counts[MAX_FIELDS];
+    unsigned long total;
+    int i, count;
+    uint8_t result;
+
+    if (argc < 3)
+    {
+        fprintf(out, "Usage: hexfind PATTERN [PATTERN...] FILENAME\n");
+        return ERR_INVALID_PARAMETER;
+    }
+
+    count = argc - 2;
+    for (i = 0; i < count; i++)
+    {
+        compiled[i] = get_pattern(cache, argv[i + 1], &result);
+        if (!compiled[i])
+        {
+            if (result == ERR_OUT_OF_MEMORY)
+                fprintf(out, "Can't allocate memory for patterns.\n");
+            else
+                fprintf(out, "Pattern can't be parsed as hex.\n");
+            return result;
+        }
+    }
+
+    result = open_image(cache, argv[argc - 1], &entry);
+    print_image_error(out, result);
+    if (result)
+        return result;
+
+    total = 0;
+    for (i = 0; i < count; i++)
+    {
+        counts[i] = count_compiled(compiled[i], entry->image.data, entry->image.data + entry->image.size);
+        total += counts[i];
+    }
+
+    if (count > 1)
+    {
+        for (i = 0; i < count; i++)
+            fprintf(out, "%s %lu\n", argv[i + 1], counts[i]);
+    }
+    else if (total)
+        fprintf(out, "%lu\n", total);
+
+    return total ? ERR_SUCCESS : ERR_NOT_FOUND;
+}
+
+/* findver prefix pattern offset end_marker max_length num_location FILE */
+static uint8_t serve_findver(server_cache* cache, int argc, char* argv[], FILE* out)
+{
+    compiled_pattern* compiled;
+    cached_image* entry;
+    const uint8_t* found;
+    const uint8_t* end;
+    uint8_t* end_marker;
+    size_t end_marker_length;
+    long offset;
+    unsigned long max_length;
+    long num_location;
+    long count;
+    uint8_t result;
+
+    if (argc != 8)
+    {
+        fprintf(out, "Usage: findver prefix pattern offset end_marker max_length num_location FILE\n");
+        return ERR_INVALID_PARAMETER;
+    }
+
+    result = open_image(cache, argv[7], &entry);
+    print_image_error(out, result);
+    if (result)
+        return result;
+
+    compiled = get_pattern(cache, argv[2], &result);
+    if (!compiled)
+    {
+        if (result == ERR_OUT_OF_MEMORY)
+            fprintf(out, "Can't allocate memory for patterns.\n");
+        else
+            fprintf(out, "Pattern can't be parsed as hex.\n");
+        return result;
+    }
+
+    offset = strtol(argv[3], NULL, 10);
+    result = read_pattern(argv[4], &end_marker, NULL, &end_marker_length);
+    if (result == ERR_OUT_OF_MEMORY)
+    {
+        fprintf(out, "Can't allocate memory for patterns.\n");
+        return result;
+    }
+    if (result || !end_marker_length)
+    {
+        if (!result)
+            free(end_marker);
+        fprintf(out, "Pattern can't be parsed as hex.\n");
+        return ERR_INVALID_PARAMETER;
+    }
+    max_length = labs(strtol(argv[5], NULL, 10));
+    num_location = strtol(argv[6], NULL, 10);
+    if (!max_length || !num_location)
+    {
+        free(end_marker);
+        return ERR_INVALID_PARAMETER;
+    }
+
+    end = entry->image.data + entry->image.size;
+    count = 0;
+    for (found = search_compiled(compiled, entry->image.data, end); found && count < num_location;
+         found = search_compiled(compiled, found + 1, end))
+    {
+        print_location(out, argv[1], entry->image.data, found, end, offset, *end_marker, max_length);
+        count++;
+    }
+    free(end_marker);
+
+    return count ? ERR_SUCCESS : ERR_NOT_FOUND;
+}
+
+/* drvver DRIVERFILE */
+static uint8_t serve_drvver(server_cache* cache, int argc, char* argv[], FILE* out)
+{
+    cached_image* entry;
+    uint8_t result;
+
+    if (argc != 2)
+    {
+        fprintf(out, "Usage: drvver DRIVERFILE\n");
+        return ERR_INVALID_PARAMETER;
+    }
+
+    result = open_image(cache, argv[1], &entry);
+    print_image_error(out, result);
+    if (result)
+        return result;
+
+    /* Modules of firmware images are identified one by one, other clients wait anyway */
+    return identify_firmware(cache->drivers, entry->image.data, entry->image.size, 1, out);
+}
+
+static void print_stats(const server_cache* cache, FILE* out)
+{
+    size_t images = 0;
+    const cached_image* entry;
+
+    for (entry = cache->images; entry; entry = entry->next)
+        images++;
+    fprintf(out, "requests %lu\n", cache->requests);
+    fprintf(out, "images %lu\n", (unsigned long) images);
+    fprintf(out, "image_bytes %lu\n", (unsigned long) cache->image_bytes);
+    fprintf(out, "memory_cap %lu\n", (unsigned long) cache->memory_cap);
+    fprintf(out, "image_hits %lu\n", cache->image_hits);
+    fprintf(out, "image_loads %lu\n", cache->image_loads);
+    fprintf(out, "image_evictions %lu\n", cache->image_evictions);
+    fprintf(out, "patterns %lu\n", (unsigned long) cache->pattern_count);
+    fprintf(out, "pattern_hits %lu\n", cache->pattern_hits);
+    fprintf(out, "pattern_compiles %lu\n", cache->pattern_compiles);
+}
+
+/* Answers one request line, output of the tool is followed by "= CODE" line
+*  with its return code. Returns nonzero when the client asked to quit */
+static int serve_request(server_cache* cache, char* line, FILE* out)
+{
+    char* fields[MAX_FIELDS];
+    int count;
+    uint8_t result;
+
+    for (count = 0; count < MAX_FIELDS; count++)
+        if (!(fields[count] = next_field(&line)))
+            break;
+    if (!count)
+        return 0;
+    if (!strcmp(fields[0], "quit"))
+        return 1;
+
+    cache->clock++;
+    cache->requests++;
+    result = ERR_SUCCESS;
+    if (count == MAX_FIELDS && next_field(&line))
+    {
+        fprintf(out, "Request has too many fields.\n");
+        result = ERR_INVALID_PARAMETER;
+    }
+    else if (!strcmp(fields[0], "hexfind"))
+        result = serve_hexfind(cache, count, fields, out);
+    else if (!strcmp(fields[0], "findver"))
+        result = serve_findver(cache, count, fields, out);
+    else if (!strcmp(fields[0], "drvver"))
+        result = serve_drvver(cache, count, fields, out);
+    else if (!strcmp(fields[0], "stats"))
+        print_stats(cache, out);
+    else
+    {
+        fprintf(out, "Unknown request %s.\n", fields[0]);
+        result = ERR_INVALID_PARAMETER;
+    }
+
+    fprintf(out, "= %u\n", result);
+    fflush(out);
+    return 0;
+}
+
+/* Line protocol on standard streams, ends at end of input or quit */
+static uint8_t serve_stream(server_cache* cache, FILE* in, FILE* out)
+{
+    char* line;
+    size_t length;
+
+    line = (char*) malloc(MAX_REQUEST);
+    if (!line)
+    {
+        printf("Can't allocate memory for requests.\n");
+        return ERR_OUT_OF_MEMORY;
+    }
+
+    while (fgets(line, MAX_REQUEST, in))
+    {
+        length = strlen(line);
+        if (length && line[length - 1] != '\n' && !feof(in))
+        {
+            /* Skipping the rest of a line that doesn't fit */
+            while (fgets(line, MAX_REQUEST, in) && line[strlen(line) - 1] != '\n')
+                ;
+            fprintf(out, "Request is too long.\n= %u\n", ERR_INVALID_PARAMETER);
+            fflush(out);
+            continue;
+        }
+        while (length && (line[length - 1] == '\n' || line[length - 1] == '\r'))
+            line[--length] = 0;
+        if (serve_request(cache, line, out))
+            break;
+    }
+
+    free(line);
+    return ERR_SUCCESS;
+}
+
+#ifndef _WIN32
+/* Connection with the part of the next request received so far */
+typedef struct
+{
+    int   fd;
+    FILE* out;
+    char* line;
+    size_t used;
+} client;
+
+static void close_client(client* connection)
+{
+    fclose(connection->out);
+    free(connection->line);
+    connection->fd = -1;
+    connection->out = NULL;
+    connection->line = NULL;
+    connection->used = 0;
+}
+
+/* Answers complete lines received from client, returns nonzero if it has to be closed */
+static int serve_client(server_cache* cache, client* connection)
+{
+    ssize_t received;
+    char* line;
+    char* newline;
+    size_t length;
+
+    received = read(connection->fd, connection->line + connection->used, MAX_REQUEST - connection->used);
+    if (received <= 0)
+        return received < 0 && errno == EINTR ? 0 : 1;
+    connection->used += (size_t) received;
+
+    line = connection->line;
+    while ((newline = (char*) memchr(line, '\n', connection->used - (line - connection->line))) != NULL)
+    {
+        *newline = 0;
+        length = newline - line;
+        if (length && line[length - 1] == '\r')
+            line[length - 1] = 0;
+        if (serve_request(cache, line, connection->out))
+            return 1;
+        line = newline + 1;
+    }
+
+    connection->used -= line - connection->line;
+    memmove(connection->line, line, connection->used);
+    if (connection->used == MAX_REQUEST)
+    {
+        fprintf(connection->out, "Request is too long.\n= %u\n", ERR_INVALID_PARAMETER);
+        fflush(connection->out);
+        return 1;
+    }
+    return 0;
+}
+
+/* Line protocol on Unix domain socket, clients are served in turn by one thread,
+*  so cached images and patterns need no locking */
+static uint8_t serve_socket(server_cache* cache, const char* path)
+{
+    struct sockaddr_un address;
+    struct pollfd polled[MAX_CLIENTS + 1];
+    client clients[MAX_CLIENTS];
+    struct stat info;
+    int listener;
+    int fd;
+    int i, j, count;
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path))
+    {
+        printf("Socket path is too long.\n");
+        return ERR_INVALID_PARAMETER;
+    }
+    strcpy(address.sun_path, path);
+
+    /* Socket left by a server that was killed is replaced, other files are not */
+    if (!stat(path, &info) && S_ISSOCK(info.st_mode))
+        unlink(path);
+
+    listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0 || bind(listener, (struct sockaddr*) &address, sizeof(address)) || listen(listener, MAX_CLIENTS))
+    {
+        printf("Socket can't be opened.\n");
+        return ERR_FILE_OPEN;
+    }
+
+    for (i = 0; i < MAX_CLIENTS; i++)
+        clients[i].fd = -1;
+
+    while (!stopping)
+    {
+        /* Listener is polled only while there is room for another client */
+        count = 0;
+        for (i = 0; i < MAX_CLIENTS; i++)
+        {
+            if (clients[i].fd < 0)
+                continue;
+            polled[count].fd = clients[i].fd;
+            polled[count].events = POLLIN;
+            polled[count].revents = 0;
+            count++;
+        }
+        if (count < MAX_CLIENTS)
+        {
+            polled[count].fd = listener;
+            polled[count].events = POLLIN;
+            polled[count].revents = 0;
+            count++;
+        }
+
+        if (poll(polled, count, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        for (i = 0; i < MAX_CLIENTS; i++)
+        {
+            if (clients[i].fd < 0)
+                continue;
+            for (j = 0; j < count && polled[j].fd != clients[i].fd; j++)
+                ;
+            if (j < count && polled[j].revents && serve_client(cache, &clients[i]))
+                close_client(&clients[i]);
+        }
+
+        if (polled[count - 1].fd == listener && (polled[count - 1].revents & POLLIN))
+        {
+            fd = accept(listener, NULL, NULL);
+            if (fd < 0)
+                continue;
+            for (i = 0; i < MAX_CLIENTS && clients[i].fd >= 0; i++)
+                ;
+            clients[i].line = (char*) malloc(MAX_REQUEST);
+            clients[i].out = clients[i].line ? fdopen(fd, "w") : NULL;
+            if (!clients[i].out)
+            {
+                free(clients[i].line);
+                close(fd);
+                continue;
+            }
+            clients[i].fd = fd;
+            clients[i].used = 0;
+        }
+    }
+
+    for (i = 0; i < MAX_CLIENTS; i++)
+        if (clients[i].fd >= 0)
+            close_client(&clients[i]);
+    close(listener);
+    unlink(path);
+    return ERR_SUCCESS;
+}
+#endif
+
+static void free_cache(server_cache* cache)
+{
+    cached_pattern* entry;
+    size_t i;
+
+    while (cache->images)
+        drop_image(cache, cache->images);
+    close_driver_database(cache->drivers);
+    for (i = 0; i < PATTERN_BUCKETS; i++)
+    {
+        while ((entry = cache->patterns[i]) != NULL)
+        {
+            cache->patterns[i] = entry->next;
+            free_compiled_pattern(entry->compiled);
+            free(entry->text);
+            free(entry);
+        }
+    }
+}
+
+/* Entry point */
+int main(int argc, char* argv[])
+{
+    server_cache cache;
+    const char* socket_path;
+    unsigned long memory_cap;
+    int arg;
+    uint8_t result;
+
+    /* Parsing options */
+    socket_path = NULL;
+    memory_cap = DEFAULT_MEMORY_CAP;
+    for (arg = 1; arg < argc; arg++)
+    {
+        if (!strcmp(argv[arg], "-s") && arg + 1 < argc)
+            socket_path = argv[++arg];
+        else if (!strcmp(argv[arg], "-m") && arg + 1 < argc)
+            memory_cap = strtoul(argv[++arg], NULL, 10);
+        else
+        {
+            printf("ubuserve v0.1.0\n"
+                "Answers hexfind, findver and drvver requests on images kept in memory\n\n"
+                "Usage: ubuserve [-m MB] [-s SOCKET]\n"
+                "Options:\n"
+                "-m MB      - Memory for mapped images in megabytes, 1024 by default,\n"
+                "             least recently used images are unmapped to stay under it\n"
+                "-s SOCKET  - Listen on Unix domain socket instead of standard input\n\n"
+                "Every request is one line, fields may be quoted to keep spaces:\n"
+                "hexfind PATTERN [PATTERN...] FILENAME\n"
+                "findver prefix pattern offset end_marker max_length num_location FILE\n"
+                "drvver DRIVERFILE\n"
+                "stats\n"
+                "quit\n"
+                "Answer is the output of the tool followed by \"= CODE\" line with its return code.\n"
+                "Files are opened relative to the working directory of the server,\n"
+                "files changed since they were mapped are mapped again.\n");
+            return ERR_INVALID_PARAMETER;
+        }
+    }
+
+    memset(&cache, 0, sizeof(cache));
+    cache.memory_cap = (size_t) memory_cap * 1024 * 1024;
+    cache.drivers = open_driver_database();
+    if (!cache.drivers)
+    {
+        printf("Can't allocate memory for signatures.\n");
+        return ERR_OUT_OF_MEMORY;
+    }
+
+    if (socket_path)
+    {
+#ifdef _WIN32
+        printf("Unix domain sockets are not supported on this platform.\n");
+        result = ERR_INVALID_PARAMETER;
+#else
+        /* Socket is removed on exit, client that disconnects
+        *  before reading its answer must not stop the server */
+        signal(SIGINT, stop_server);
+        signal(SIGTERM, stop_server);
+        signal(SIGPIPE, SIG_IGN);
+        result = serve_socket(&cache, socket_path);
+#endif
+    }
+    else
+        result = serve_stream(&cache, stdin, stdout);
+
+    free_cache(&cache);
+    return result;
+}